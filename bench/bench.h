@@ -0,0 +1,75 @@
+#pragma once
+
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace ambient {
+
+    struct BenchOptions {
+        std::string filter;       // run only benchmarks whose name contains this
+        size_t min_samples = 15;  // timed repetitions, at least
+        double min_time_ms = 200; // and at least this much timed work
+        size_t trials = 200;      // scripted bursts per latency case
+    };
+
+    // Times a callable repeatedly after one warm-up run and prints one JSON
+    // object per benchmark on stdout. Throughput is derived from the median,
+    // which is also returned (0 when the benchmark is filtered out).
+    class BenchRunner {
+    public:
+        explicit BenchRunner(const BenchOptions& options) : options(options) {}
+
+        bool enabled(const std::string& name) const {
+            return options.filter.empty() || name.find(options.filter) != std::string::npos;
+        }
+
+        template <typename Fn>
+        double run(const std::string& name, const std::string& input, const std::string& variant,
+                 double bytes_per_iteration, Fn&& fn) {
+            if (!enabled(name)) {
+                return 0.0;
+            }
+
+            using Clock = std::chrono::steady_clock;
+            fn();
+
+            std::vector<double> samples;
+            double total_ns = 0.0;
+            while (samples.size() < options.min_samples || total_ns < options.min_time_ms * 1e6) {
+                auto start = Clock::now();
+                fn();
+                double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+                samples.push_back(ns);
+                total_ns += ns;
+            }
+
+            std::sort(samples.begin(), samples.end());
+            double median_ns = samples[samples.size() / 2];
+            double mb_per_s = median_ns > 0.0 ? bytes_per_iteration / median_ns * 1e3 : 0.0;
+
+            std::printf("{\"bench\":\"%s\",\"input\":\"%s\",\"variant\":\"%s\",\"simd\":\"%s\","
+                        "\"samples\":%zu,\"median_ns\":%.0f,\"min_ns\":%.0f,\"max_ns\":%.0f,"
+                        "\"bytes\":%.0f,\"mb_per_s\":%.2f}\n",
+                        name.c_str(), input.c_str(), variant.c_str(), simdLevelName(detectSimdLevel()),
+                        samples.size(), median_ns, samples.front(), samples.back(),
+                        bytes_per_iteration, mb_per_s);
+            std::fflush(stdout);
+            return median_ns;
+        }
+
+    private:
+        BenchOptions options;
+    };
+
+    // Keeps a computed value alive so the optimiser cannot drop the work.
+    template <typename T>
+    inline void doNotOptimize(const T& value) {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,500 @@
+#include "bench.h"
+#include "latency_bench.h"
+#include "synthetic_ogg.h"
+
+#include "activity_detector.h"
+#include "audio_source.h"
+#include "gain.h"
+#include "generator_source.h"
+#include "loudness.h"
+#include "mapped_file.h"
+#include "mixer_source.h"
+#include "ogg_decoder.h"
+#include "output_reference.h"
+#include "resampler.h"
+
+#ifdef AMBIENT_EMBED_TRACK
+#include "audio.h"
+#endif
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+using namespace ambient;
+
+namespace {
+
+    struct BenchInput {
+        std::string name;
+        std::vector<uint8_t> owned;
+        MappedFile file;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    // Matches AudioPlayer's chunk, so the playback numbers are per write.
+    constexpr size_t PLAYBACK_CHUNK = 4096;
+    constexpr size_t PLAYBACK_CHUNKS_PER_ITERATION = 256;
+
+    // The service default, so decode numbers include building the seam.
+    constexpr int LOOP_CROSSFADE_MS = 500;
+
+    // A typical monitor fragment: ~21 ms at 48 kHz stereo.
+    constexpr size_t MONITOR_FRAMES = 1024;
+    constexpr unsigned MONITOR_CHANNELS = 2;
+
+    std::vector<SimdLevel> availableSimdLevels() {
+        std::vector<SimdLevel> levels{SimdLevel::Scalar};
+#if defined(AMBIENT_SIMD_X86)
+        levels.push_back(SimdLevel::Sse2);
+        if (detectSimdLevel() == SimdLevel::Avx2) {
+            levels.push_back(SimdLevel::Avx2);
+        }
+#elif defined(AMBIENT_SIMD_NEON)
+        levels.push_back(SimdLevel::Neon);
+#endif
+        return levels;
+    }
+
+    std::vector<uint8_t> makeMonitorFragment(SampleFormat format, std::mt19937& rng) {
+        std::normal_distribution<float> noise(0.0f, 0.1f);
+        const size_t samples = MONITOR_FRAMES * MONITOR_CHANNELS;
+        std::vector<uint8_t> bytes(samples * bytesPerSample(format));
+
+        for (size_t i = 0; i < samples; ++i) {
+            float v = std::max(-1.0f, std::min(1.0f, noise(rng)));
+            switch (format) {
+                case SampleFormat::S16LE: {
+                    int16_t s = static_cast<int16_t>(v * 32767.0f);
+                    std::memcpy(&bytes[i * 2], &s, 2);
+                    break;
+                }
+                case SampleFormat::S32LE: {
+                    int32_t s = static_cast<int32_t>(v * 2147483647.0f);
+                    std::memcpy(&bytes[i * 4], &s, 4);
+                    break;
+                }
+                default:
+                    std::memcpy(&bytes[i * 4], &v, 4);
+                    break;
+            }
+        }
+        return bytes;
+    }
+
+    void benchDecode(BenchRunner& runner, const BenchInput& input) {
+        OggDecoder probe;
+        probe.setLoopCrossfade(LOOP_CROSSFADE_MS);
+        if (!probe.decode(input.data, input.size)) {
+            std::cerr << input.name << ": " << probe.getLastError() << std::endl;
+            return;
+        }
+        const double pcm_bytes = static_cast<double>(probe.getPcmData().size());
+
+        runner.run("decode", input.name, "full", pcm_bytes, [&]() {
+            OggDecoder decoder;
+            decoder.setLoopCrossfade(LOOP_CROSSFADE_MS);
+            decoder.decode(input.data, input.size);
+            doNotOptimize(decoder.getPcmData().data());
+        });
+
+        runner.run("decode", input.name, "parallel", pcm_bytes, [&]() {
+            OggDecoder decoder;
+            decoder.setLoopCrossfade(LOOP_CROSSFADE_MS);
+            decoder.setDecodeThreads(0);
+            decoder.decode(input.data, input.size);
+            doNotOptimize(decoder.getPcmData().data());
+        });
+
+        runner.run("decode", input.name, "streaming", pcm_bytes, [&]() {
+            StreamingSource source;
+            source.open(input.data, input.size, LOOP_CROSSFADE_MS);
+            std::vector<uint8_t> chunk(PLAYBACK_CHUNK);
+            for (double left = pcm_bytes; left > 0; left -= static_cast<double>(chunk.size())) {
+                if (source.read(chunk.data(), chunk.size()) == 0) {
+                    break;
+                }
+            }
+            doNotOptimize(chunk.data());
+        });
+    }
+
+    // Per-fragment work of the monitor read callback: loudness kernel,
+    // RMS and one detector update.
+    void benchMonitor(BenchRunner& runner) {
+        std::mt19937 rng(7);
+        const SampleFormat formats[] = {SampleFormat::S16LE, SampleFormat::S32LE, SampleFormat::Float32LE};
+        const char* detectors[] = {"mean", "ewma", "peak"};
+
+        for (SampleFormat format : formats) {
+            std::vector<uint8_t> fragment = makeMonitorFragment(format, rng);
+            const size_t samples = MONITOR_FRAMES * MONITOR_CHANNELS;
+            const double duration_ms = 1000.0 * MONITOR_FRAMES / 48000;
+
+            for (SimdLevel level : availableSimdLevels()) {
+                LoudnessKernel kernel = selectLoudnessKernel(format, level);
+                runner.run("loudness", sampleFormatName(format), simdLevelName(level),
+                           static_cast<double>(fragment.size()), [&]() {
+                    doNotOptimize(kernel(fragment.data(), samples));
+                });
+            }
+
+            for (const char* type : detectors) {
+                DetectorSettings settings;
+                settings.type = type;
+                std::unique_ptr<ActivityDetector> detector = makeActivityDetector(settings);
+                LoudnessKernel kernel = selectLoudnessKernel(format);
+                runner.run("monitor_fragment", sampleFormatName(format), type,
+                           static_cast<double>(fragment.size()), [&]() {
+                    double level = std::sqrt(kernel(fragment.data(), samples));
+                    doNotOptimize(detector->update(level, duration_ms));
+                });
+            }
+
+            // Reference cancellation at steady state: the fragment is our
+            // own output, already locked onto the right lag.
+            OutputReference reference;
+            reference.setFormat(format, MONITOR_CHANNELS, 48000);
+            for (int i = 0; i < 64; ++i) {
+                reference.push(fragment.data(), MONITOR_FRAMES);
+            }
+            ReferenceCanceller canceller;
+            canceller.setFormat(format, MONITOR_CHANNELS, 48000);
+            const int64_t end_frame = 64 * MONITOR_FRAMES;
+            canceller.explainedFraction(fragment.data(), MONITOR_FRAMES, reference, end_frame);
+            runner.run("monitor_cancel", sampleFormatName(format), "locked",
+                       static_cast<double>(fragment.size()), [&]() {
+                doNotOptimize(canceller.explainedFraction(fragment.data(), MONITOR_FRAMES, reference, end_frame));
+            });
+            runner.run("monitor_cancel", sampleFormatName(format), "search",
+                       static_cast<double>(fragment.size()), [&]() {
+                canceller.reset();
+                doNotOptimize(canceller.explainedFraction(fragment.data(), MONITOR_FRAMES, reference, end_frame));
+            });
+        }
+    }
+
+    // One minute of monitoring per capture profile: the read callback's
+    // loudness, cancellation and detector work for every fragment the server
+    // sends in that time. Server-side downmixing and decimation are not
+    // counted; the fragment rate is, and so is the wakeup count it implies.
+    void benchMonitorProfiles(BenchRunner& runner) {
+        if (!runner.enabled("monitor_profile")) {
+            return;
+        }
+
+        struct Profile {
+            const char* name;
+            SampleFormat format;
+            unsigned channels;
+            uint32_t rate;
+            size_t fragment_frames;
+            bool cancel;
+        };
+        const uint32_t sink_rate = 48000;
+        const size_t window_frames = static_cast<size_t>(DetectorSettings().window_ms * 8000 / 1000);
+        const Profile profiles[] = {
+            {"native", SampleFormat::S16LE, MONITOR_CHANNELS, sink_rate, MONITOR_FRAMES, true},
+            {"lowrate", SampleFormat::Float32LE, 1, 8000, window_frames, true},
+            {"peak", SampleFormat::Float32LE, 1, 100, window_frames * 100 / 8000, false},
+        };
+
+        // Our own output, repeating; every profile's fragment is that output
+        // as the server would capture it, so cancellation runs locked.
+        std::mt19937 rng(13);
+        std::vector<uint8_t> output = makeMonitorFragment(SampleFormat::S16LE, rng);
+        OutputReference reference;
+        reference.setFormat(SampleFormat::S16LE, MONITOR_CHANNELS, sink_rate);
+        for (int i = 0; i < 64; ++i) {
+            reference.push(output.data(), MONITOR_FRAMES);
+        }
+        const int64_t end_frame = 64 * MONITOR_FRAMES;
+
+        for (const Profile& profile : profiles) {
+            std::vector<uint8_t> fragment;
+            if (profile.format == SampleFormat::S16LE) {
+                fragment = output;
+            } else {
+                const size_t step = sink_rate / profile.rate;
+                std::vector<float> mono(profile.fragment_frames);
+                for (size_t j = 0; j < mono.size(); ++j) {
+                    size_t frame = static_cast<size_t>(end_frame - static_cast<int64_t>((mono.size() - j) * step)) % MONITOR_FRAMES;
+                    int16_t l, r;
+                    std::memcpy(&l, &output[frame * 4], 2);
+                    std::memcpy(&r, &output[frame * 4 + 2], 2);
+                    mono[j] = (l + r) / 65536.0f;
+                }
+                fragment.resize(mono.size() * sizeof(float));
+                std::memcpy(fragment.data(), mono.data(), fragment.size());
+            }
+
+            const size_t samples = profile.fragment_frames * profile.channels;
+            const double duration_ms = 1000.0 * profile.fragment_frames / profile.rate;
+            const size_t fragments_per_minute = static_cast<size_t>(std::lround(60000.0 / duration_ms));
+            LoudnessKernel kernel = selectLoudnessKernel(profile.format);
+            std::unique_ptr<ActivityDetector> detector = makeActivityDetector(DetectorSettings());
+            ReferenceCanceller canceller;
+            canceller.setFormat(profile.format, profile.channels, profile.rate);
+
+            double ns = runner.run("monitor_profile", profile.name, "minute",
+                                   static_cast<double>(fragment.size() * fragments_per_minute), [&]() {
+                for (size_t i = 0; i < fragments_per_minute; ++i) {
+                    double mean_square = kernel(fragment.data(), samples);
+                    if (profile.cancel) {
+                        mean_square *= 1.0 - canceller.explainedFraction(fragment.data(), profile.fragment_frames,
+                                                                         reference, end_frame);
+                    }
+                    doNotOptimize(detector->update(std::sqrt(mean_square), duration_ms));
+                }
+            });
+            std::printf("{\"bench\":\"monitor_hour\",\"input\":\"%s\",\"fragments_per_hour\":%zu,"
+                        "\"cpu_ms_per_hour\":%.3f}\n",
+                        profile.name, fragments_per_minute * 60, ns * 60 / 1e6);
+        }
+    }
+
+    // Load-time conversion of a decoded track to a typical sink spec, per
+    // filter kernel; one second of stereo input per iteration.
+    void benchResample(BenchRunner& runner) {
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+        const unsigned channels = 2;
+
+        struct Conversion {
+            uint32_t from;
+            uint32_t to;
+        };
+        for (const Conversion& conversion : {Conversion{44100, 48000}, Conversion{48000, 44100}}) {
+            std::vector<float> input(static_cast<size_t>(conversion.from) * channels);
+            for (float& v : input) {
+                v = noise(rng);
+            }
+            std::vector<float> output;
+            const std::string name = std::to_string(conversion.from) + "_to_" + std::to_string(conversion.to);
+
+            for (SimdLevel level : availableSimdLevels()) {
+                Resampler resampler;
+                resampler.setup(conversion.from, conversion.to, channels, level);
+                runner.run("resample", name, simdLevelName(level), static_cast<double>(input.size() * sizeof(float)), [&]() {
+                    output.clear();
+                    resampler.process(input.data(), conversion.from, output);
+                    doNotOptimize(output.data());
+                });
+            }
+        }
+    }
+
+    // The generator source: its noise kernel per instruction set, then one
+    // second of 48 kHz stereo per type in playback-sized reads. The share
+    // of a core is that second's median time.
+    void benchGenerator(BenchRunner& runner) {
+        const uint32_t rate = GeneratorSource::DEFAULT_RATE;
+        const unsigned channels = 2;
+        std::vector<float> noise(static_cast<size_t>(rate) * channels);
+
+        for (SimdLevel level : availableSimdLevels()) {
+            uint32_t lanes[NOISE_LANES] = {1, 2, 3, 4, 5, 6, 7, 8};
+            NoiseKernel kernel = selectNoiseKernel(level);
+            runner.run("noise", "white", simdLevelName(level), static_cast<double>(noise.size() * sizeof(float)), [&]() {
+                kernel(lanes, noise.data(), noise.size());
+                doNotOptimize(noise.data());
+            });
+        }
+
+        const char* types[] = {"pink", "brown", "rain", "wind"};
+        for (const char* name : types) {
+            GeneratorType type;
+            toGeneratorType(name, type);
+            GeneratorSource source(type, rate, channels, SampleFormat::S16LE, 1);
+            std::vector<uint8_t> chunk(PLAYBACK_CHUNK);
+            const size_t second = static_cast<size_t>(rate) * channels * 2;
+
+            double ns = runner.run("generator", name, "s16le", static_cast<double>(second), [&]() {
+                for (size_t done = 0; done < second; done += chunk.size()) {
+                    source.read(chunk.data(), chunk.size());
+                }
+                doNotOptimize(chunk.data());
+            });
+            if (ns > 0.0) {
+                std::printf("{\"bench\":\"generator_load\",\"input\":\"%s\",\"rate\":%u,\"channels\":%u,"
+                            "\"core_percent\":%.3f,\"bytes\":%zu}\n",
+                            name, rate, channels, ns / 1e9 * 100.0, sizeof(GeneratorSource));
+                std::fflush(stdout);
+            }
+        }
+    }
+
+    // One second of 48 kHz stereo mixed from 1 to 8 looping layers at
+    // steady partial gain, per mix kernel, so the per-layer cost is the
+    // slope between rows.
+    void benchMixer(BenchRunner& runner) {
+        const uint32_t rate = 48000;
+        const unsigned channels = 2;
+        std::mt19937 rng(13);
+        std::uniform_int_distribution<int> noise(-8000, 8000);
+        std::vector<int16_t> loop(static_cast<size_t>(rate) * channels);
+        for (int16_t& v : loop) {
+            v = static_cast<int16_t>(noise(rng));
+        }
+        std::vector<uint8_t> pcm(reinterpret_cast<const uint8_t*>(loop.data()),
+                                 reinterpret_cast<const uint8_t*>(loop.data() + loop.size()));
+        const size_t second = pcm.size();
+
+        for (SimdLevel level : availableSimdLevels()) {
+            for (size_t count : {1, 2, 4, 8}) {
+                MixerSource mixer(rate, channels, SampleFormat::S16LE, level);
+                for (size_t i = 0; i < count; ++i) {
+                    mixer.addLayer(std::make_unique<BufferSource>(pcm), channels, 0.5);
+                }
+                std::vector<uint8_t> chunk(PLAYBACK_CHUNK);
+
+                runner.run("mixer", std::to_string(count) + "_layers", simdLevelName(level),
+                           static_cast<double>(second), [&]() {
+                    for (size_t done = 0; done < second; done += chunk.size()) {
+                        mixer.read(chunk.data(), chunk.size());
+                    }
+                    doNotOptimize(chunk.data());
+                });
+            }
+        }
+    }
+
+    // The render loop behind each playback write: source read, gain stage
+    // and reference capture, in AudioPlayer-sized chunks.
+    void benchPlayback(BenchRunner& runner, const BenchInput& input) {
+        OggDecoder decoder;
+        if (!decoder.decode(input.data, input.size)) {
+            return;
+        }
+        const unsigned channels = decoder.getChannels();
+        const size_t frame_size = channels * 2;
+        const size_t chunk = PLAYBACK_CHUNK / frame_size * frame_size;
+        BufferSource source(decoder.takePcmData());
+
+        struct Variant {
+            const char* name;
+            float gain;
+            bool ramp;
+        };
+        const Variant variants[] = {{"unity", 1.0f, false}, {"steady", 0.5f, false}, {"ramp", 0.5f, true}};
+
+        for (const Variant& variant : variants) {
+            GainRamp gain;
+            gain.setFormat(SampleFormat::S16LE, channels);
+            gain.setGain(variant.gain);
+            OutputReference reference;
+            reference.setFormat(SampleFormat::S16LE, channels, decoder.getSampleRate());
+            std::vector<uint8_t> buffer(chunk);
+            const size_t ramp_frames = chunk / frame_size * PLAYBACK_CHUNKS_PER_ITERATION;
+
+            runner.run("playback_chunk", input.name, variant.name,
+                       static_cast<double>(chunk * PLAYBACK_CHUNKS_PER_ITERATION), [&]() {
+                if (variant.ramp) {
+                    gain.rampTo(gain.getTarget() == 0.5f ? 0.25f : 0.5f, ramp_frames, RampShape::Exponential);
+                }
+                for (size_t i = 0; i < PLAYBACK_CHUNKS_PER_ITERATION; ++i) {
+                    size_t filled = source.read(buffer.data(), buffer.size());
+                    gain.process(buffer.data(), filled / frame_size);
+                    reference.push(buffer.data(), filled / frame_size);
+                }
+                doNotOptimize(buffer.data());
+            });
+        }
+    }
+
+    void usage(const char* argv0) {
+        std::cerr << "usage: " << argv0 << " [--filter NAME] [--samples N] [--min-time MS] [--trials N] [track.ogg ...]\n"
+                  << "Prints one JSON object per benchmark. Synthetic inputs are always\n"
+                  << "included; each track given is benchmarked as a real input." << std::endl;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    std::vector<std::unique_ptr<BenchInput>> inputs;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--samples" && i + 1 < argc) {
+            options.min_samples = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            options.min_time_ms = std::atof(argv[++i]);
+        } else if (arg == "--trials" && i + 1 < argc) {
+            options.trials = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "-h" || arg == "--help" || arg.rfind("--", 0) == 0) {
+            usage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    struct Synthetic {
+        uint32_t rate;
+        unsigned channels;
+        double seconds;
+    };
+    for (const Synthetic& s : {Synthetic{44100, 2, 20.0}, Synthetic{48000, 1, 20.0}}) {
+        auto input = std::make_unique<BenchInput>();
+        input->name = "synthetic_" + std::to_string(s.rate) + "_" + std::to_string(s.channels) + "ch";
+        input->owned = encodeSyntheticOgg(s.rate, s.channels, s.seconds);
+        if (input->owned.empty()) {
+            std::cerr << "Failed to encode " << input->name << std::endl;
+            continue;
+        }
+        input->data = input->owned.data();
+        input->size = input->owned.size();
+        inputs.push_back(std::move(input));
+    }
+
+#ifdef AMBIENT_EMBED_TRACK
+    {
+        auto input = std::make_unique<BenchInput>();
+        input->name = "embedded";
+        input->data = audio_data.data();
+        input->size = audio_size;
+        inputs.push_back(std::move(input));
+    }
+#endif
+
+    for (const std::string& path : paths) {
+        auto input = std::make_unique<BenchInput>();
+        if (!input->file.open(path)) {
+            std::cerr << path << ": " << input->file.getLastError() << std::endl;
+            return 1;
+        }
+        input->name = path.substr(path.find_last_of('/') + 1);
+        input->data = input->file.getData();
+        input->size = input->file.getSize();
+        inputs.push_back(std::move(input));
+    }
+
+    BenchRunner runner(options);
+
+    for (const auto& input : inputs) {
+        if (runner.enabled("decode")) {
+            benchDecode(runner, *input);
+        }
+        if (runner.enabled("playback_chunk")) {
+            benchPlayback(runner, *input);
+        }
+    }
+    benchMonitor(runner);
+    benchMonitorProfiles(runner);
+    benchResample(runner);
+    benchGenerator(runner);
+    benchMixer(runner);
+
+    if (runner.enabled("latency")) {
+        runLatencyBench(options);
+    }
+
+    return 0;
+}
\ No newline at end of file
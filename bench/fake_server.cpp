@@ -0,0 +1,94 @@
+#include "fake_server.h"
+
+#include "loudness.h"
+
+#include <cmath>
+
+namespace ambient {
+
+    FakeServer::FakeServer(uint32_t seed) : rng_state(seed ? seed : 1) {
+    }
+
+    MonitorBackend::Clock::time_point FakeServer::now() const {
+        return clock;
+    }
+
+    void FakeServer::armResumeTimer(std::chrono::microseconds delay) {
+        timer_deadline = clock + delay;
+        timer_armed = true;
+    }
+
+    void FakeServer::cancelResumeTimer() {
+        timer_armed = false;
+    }
+
+    bool FakeServer::isPlaying() const {
+        return playing;
+    }
+
+    void FakeServer::play() {
+        playing = true;
+        events.push_back({clock, true});
+    }
+
+    void FakeServer::pause() {
+        playing = false;
+        events.push_back({clock, false});
+    }
+
+    const std::vector<FakeServer::Event>& FakeServer::getEvents() const {
+        return events;
+    }
+
+    void FakeServer::advance(std::chrono::microseconds delta, ActivityMonitor& monitor) {
+        Clock::time_point target = clock + delta;
+        while (timer_armed && timer_deadline <= target) {
+            clock = timer_deadline;
+            timer_armed = false;
+            monitor.onResumeTimer();
+        }
+        clock = target;
+    }
+
+    void FakeServer::replay(const std::vector<ScriptSegment>& script, double fragment_ms, ActivityMonitor& monitor) {
+        const LoudnessKernel kernel = selectLoudnessKernel(SampleFormat::Float32LE);
+        const size_t frames = static_cast<size_t>(fragment_ms * SAMPLE_RATE / 1000.0);
+        const auto fragment_duration = std::chrono::microseconds(static_cast<int64_t>(frames) * 1000000 / SAMPLE_RATE);
+        const double duration_ms = 1000.0 * frames / SAMPLE_RATE;
+        fragment.resize(frames * CHANNELS);
+
+        // Fragments follow the script's timeline rather than each segment,
+        // so one fragment may span several segments; ones longer than a
+        // segment would otherwise round it away.
+        double total_ms = 0.0;
+        for (const ScriptSegment& segment : script) {
+            total_ms += segment.duration_ms;
+        }
+        const size_t count = static_cast<size_t>(std::lround(total_ms / fragment_ms));
+
+        size_t current = 0;
+        double segment_end_ms = script.empty() ? 0.0 : script[0].duration_ms;
+        for (size_t n = 0; n < count; ++n) {
+            for (size_t frame = 0; frame < frames; ++frame) {
+                const double t_ms = 1000.0 * (n * frames + frame) / SAMPLE_RATE;
+                while (current + 1 < script.size() && t_ms >= segment_end_ms) {
+                    segment_end_ms += script[++current].duration_ms;
+                }
+
+                // Uniform noise of amplitude a has RMS a / sqrt(3).
+                const float amplitude = script.empty() ? 0.0f : script[current].rms * std::sqrt(3.0f);
+                for (unsigned c = 0; c < CHANNELS; ++c) {
+                    rng_state ^= rng_state << 13;
+                    rng_state ^= rng_state >> 17;
+                    rng_state ^= rng_state << 5;
+                    fragment[frame * CHANNELS + c] = amplitude * (static_cast<float>(rng_state) / 2147483648.0f - 1.0f);
+                }
+            }
+
+            // A fragment is delivered once it has been captured.
+            advance(fragment_duration, monitor);
+            monitor.onFragment(kernel(fragment.data(), fragment.size()), duration_ms);
+        }
+    }
+
+} //ambient
\ No newline at end of file
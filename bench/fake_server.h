@@ -0,0 +1,59 @@
+#pragma once
+
+#include "activity_monitor.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace ambient {
+
+    // One stretch of scripted monitor input: noise from other applications
+    // at `rms` (0 for silence) lasting `duration_ms`.
+    struct ScriptSegment {
+        double duration_ms;
+        float rms;
+    };
+
+    // In-process stand-in for the sound server and player. Time is virtual
+    // and only moves when the script is replayed; the player just records
+    // when it was told to play or pause.
+    class FakeServer : public MonitorBackend {
+    public:
+        struct Event {
+            Clock::time_point time;
+            bool playing;
+        };
+
+        explicit FakeServer(uint32_t seed = 1);
+
+        Clock::time_point now() const override;
+        void armResumeTimer(std::chrono::microseconds delay) override;
+        void cancelResumeTimer() override;
+        bool isPlaying() const override;
+        void play() override;
+        void pause() override;
+
+        // Generates monitor PCM for the script in `fragment_ms` fragments,
+        // delivering each to `monitor` the way the service's read callback
+        // does and firing the resume timer when the clock passes it.
+        void replay(const std::vector<ScriptSegment>& script, double fragment_ms, ActivityMonitor& monitor);
+
+        // Moves the clock forward, firing the resume timer if it falls due.
+        void advance(std::chrono::microseconds delta, ActivityMonitor& monitor);
+
+        const std::vector<Event>& getEvents() const;
+
+        static constexpr uint32_t SAMPLE_RATE = 48000;
+        static constexpr unsigned CHANNELS = 2;
+
+    private:
+        Clock::time_point clock;
+        Clock::time_point timer_deadline;
+        bool timer_armed = false;
+        bool playing = false;
+        std::vector<Event> events;
+        std::vector<float> fragment;
+        uint32_t rng_state;
+    };
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "latency_bench.h"
+#include "fake_server.h"
+#include "latency_profile.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace ambient {
+
+    namespace {
+
+        struct LatencyCase {
+            const char* detector;
+            int resume_delay_ms;
+            double fragment_ms;
+        };
+
+        double percentile(std::vector<double> values, double p) {
+            if (values.empty()) {
+                return -1.0;
+            }
+            std::sort(values.begin(), values.end());
+            size_t index = static_cast<size_t>(std::ceil(p * values.size())) - 1;
+            return values[std::min(index, values.size() - 1)];
+        }
+
+        // A burst of another application's audio: loudness drawn per 50 ms
+        // around a base level, with the odd speech-like gap in between.
+        std::vector<ScriptSegment> makeBurst(std::mt19937& rng, double duration_ms) {
+            std::uniform_real_distribution<double> base_db(-30.0, -10.0);
+            std::uniform_real_distribution<double> wobble_db(-4.0, 4.0);
+            std::uniform_real_distribution<double> chance(0.0, 1.0);
+            std::uniform_real_distribution<double> gap_ms(50.0, 250.0);
+
+            std::vector<ScriptSegment> burst;
+            const double base = base_db(rng);
+            double elapsed = 0.0;
+            while (elapsed < duration_ms) {
+                if (elapsed > 0.0 && chance(rng) < 0.05) {
+                    double gap = std::min(gap_ms(rng), duration_ms - elapsed);
+                    burst.push_back({gap, 0.0f});
+                    elapsed += gap;
+                    continue;
+                }
+                double step = std::min(50.0, duration_ms - elapsed);
+                burst.push_back({step, static_cast<float>(std::pow(10.0, (base + wobble_db(rng)) / 20.0))});
+                elapsed += step;
+            }
+            return burst;
+        }
+
+        double toMs(MonitorBackend::Clock::duration d) {
+            return std::chrono::duration<double, std::milli>(d).count();
+        }
+
+        struct LatencyResult {
+            std::vector<double> to_pause, to_resume;
+            size_t missed = 0, spurious = 0;
+        };
+
+        LatencyResult measure(const DetectorSettings& settings, double fragment_ms, size_t trials) {
+            LatencyResult result;
+            std::uniform_real_distribution<double> burst_ms(300.0, 5000.0);
+
+            for (size_t trial = 0; trial < trials; ++trial) {
+                std::mt19937 rng(static_cast<uint32_t>(trial + 1));
+                FakeServer server(static_cast<uint32_t>(trial + 1));
+                ActivityMonitor monitor(settings, server);
+
+                // Quiet lead-in starts playback; the burst follows, then
+                // enough quiet for the resume to happen.
+                const double lead_ms = 2000.0;
+                server.replay({{lead_ms, 0.0f}}, fragment_ms, monitor);
+                const auto burst_start = server.now();
+                server.replay(makeBurst(rng, burst_ms(rng)), fragment_ms, monitor);
+                const auto burst_end = server.now();
+                server.replay({{settings.resume_delay_ms + 3000.0, 0.0f}}, fragment_ms, monitor);
+
+                bool paused = false, resumed = false;
+                size_t transitions = 0;
+                for (const FakeServer::Event& event : server.getEvents()) {
+                    if (event.time < burst_start) {
+                        continue;
+                    }
+                    ++transitions;
+                    if (!event.playing && !paused) {
+                        paused = true;
+                        result.to_pause.push_back(toMs(event.time - burst_start));
+                    } else if (event.playing && paused && event.time >= burst_end && !resumed) {
+                        resumed = true;
+                        result.to_resume.push_back(toMs(event.time - burst_end));
+                    }
+                }
+
+                if (!paused) {
+                    ++result.missed;
+                }
+                if (transitions > 2) {
+                    result.spurious += transitions - 2;
+                }
+            }
+            return result;
+        }
+
+    } // namespace
+
+    void runLatencyBench(const BenchOptions& options) {
+        const char* detectors[] = {"mean", "ewma", "peak"};
+        const int resume_delays[] = {500, 1000};
+        const double fragments[] = {10.0, 40.0};
+
+        for (const char* detector : detectors) {
+            for (int resume_delay_ms : resume_delays) {
+                for (double fragment_ms : fragments) {
+                    const LatencyCase c{detector, resume_delay_ms, fragment_ms};
+                    DetectorSettings settings;
+                    settings.type = c.detector;
+                    settings.resume_delay_ms = c.resume_delay_ms;
+
+                    LatencyResult r = measure(settings, c.fragment_ms, options.trials);
+
+                    std::printf("{\"bench\":\"latency\",\"detector\":\"%s\",\"resume_delay_ms\":%d,\"fragment_ms\":%.0f,"
+                                "\"trials\":%zu,\"pause_p50_ms\":%.1f,\"pause_p99_ms\":%.1f,"
+                                "\"resume_p50_ms\":%.1f,\"resume_p99_ms\":%.1f,\"missed\":%zu,\"spurious\":%zu}\n",
+                                c.detector, c.resume_delay_ms, c.fragment_ms, options.trials,
+                                percentile(r.to_pause, 0.5), percentile(r.to_pause, 0.99),
+                                percentile(r.to_resume, 0.5), percentile(r.to_resume, 0.99), r.missed, r.spurious);
+                    std::fflush(stdout);
+                }
+            }
+        }
+
+        // Each latency profile with the default detector: how soon a pause
+        // is decided at its monitor fragment size, against how often the
+        // playback and monitor streams wake us. Pausing flushes the playback
+        // buffer, so its length adds nothing after the decision; the fade
+        // and the sink's own latency are measured at runtime by
+        // ambient_pause_silence_seconds.
+        for (const LatencyProfile* profile = latencyProfiles(); profile->name; ++profile) {
+            DetectorSettings settings;
+            LatencyResult r = measure(settings, profile->fragment_ms, options.trials);
+            double wakeups = 1000.0 / profile->request_ms + 1000.0 / profile->fragment_ms;
+
+            std::printf("{\"bench\":\"latency_profile\",\"profile\":\"%s\",\"tlength_ms\":%d,\"minreq_ms\":%d,"
+                        "\"fragment_ms\":%d,\"wakeups_per_s\":%.1f,\"trials\":%zu,"
+                        "\"pause_p50_ms\":%.1f,\"pause_p99_ms\":%.1f,\"missed\":%zu}\n",
+                        profile->name, profile->target_ms, profile->request_ms, profile->fragment_ms, wakeups,
+                        options.trials, percentile(r.to_pause, 0.5), percentile(r.to_pause, 0.99), r.missed);
+            std::fflush(stdout);
+        }
+    }
+
+} //ambient
\ No newline at end of file
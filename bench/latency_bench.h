@@ -0,0 +1,12 @@
+#pragma once
+
+#include "bench.h"
+
+namespace ambient {
+
+    // Replays randomised activity bursts through ActivityMonitor on the fake
+    // server and prints time-to-pause / time-to-resume percentiles for each
+    // detector setting as JSON lines.
+    void runLatencyBench(const BenchOptions& options);
+
+} //ambient
\ No newline at end of file
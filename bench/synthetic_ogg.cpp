@@ -0,0 +1,98 @@
+#include "synthetic_ogg.h"
+
+#include <vorbis/vorbisenc.h>
+
+#include <cmath>
+#include <random>
+
+namespace ambient {
+
+    static void appendPage(std::vector<uint8_t>& out, const ogg_page& page) {
+        out.insert(out.end(), page.header, page.header + page.header_len);
+        out.insert(out.end(), page.body, page.body + page.body_len);
+    }
+
+    std::vector<uint8_t> encodeSyntheticOgg(uint32_t sample_rate, unsigned channels, double seconds, float quality) {
+        std::vector<uint8_t> out;
+
+        vorbis_info info;
+        vorbis_info_init(&info);
+        if (vorbis_encode_init_vbr(&info, channels, sample_rate, quality) != 0) {
+            vorbis_info_clear(&info);
+            return out;
+        }
+
+        vorbis_comment comment;
+        vorbis_comment_init(&comment);
+        vorbis_comment_add_tag(&comment, "TITLE", "desktop_ambient synthetic");
+
+        vorbis_dsp_state dsp;
+        vorbis_block block;
+        vorbis_analysis_init(&dsp, &info);
+        vorbis_block_init(&dsp, &block);
+
+        ogg_stream_state stream;
+        ogg_stream_init(&stream, 0x616d62);
+
+        ogg_packet header, header_comment, header_code;
+        vorbis_analysis_headerout(&dsp, &comment, &header, &header_comment, &header_code);
+        ogg_stream_packetin(&stream, &header);
+        ogg_stream_packetin(&stream, &header_comment);
+        ogg_stream_packetin(&stream, &header_code);
+
+        ogg_page page;
+        while (ogg_stream_flush(&stream, &page) != 0) {
+            appendPage(out, page);
+        }
+
+        std::mt19937 rng(12345);
+        std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+        std::vector<float> lowpass(channels, 0.0f);
+
+        const size_t total = static_cast<size_t>(seconds * sample_rate);
+        const size_t block_frames = 1024;
+        size_t written = 0;
+        bool eos = false;
+
+        while (!eos) {
+            size_t frames = std::min(block_frames, total - written);
+            if (frames > 0) {
+                float** buffer = vorbis_analysis_buffer(&dsp, static_cast<int>(frames));
+                for (size_t i = 0; i < frames; ++i) {
+                    double t = static_cast<double>(written + i) / sample_rate;
+                    float tone = static_cast<float>(0.08 * std::sin(2.0 * M_PI * 110.0 * t) +
+                                                    0.05 * std::sin(2.0 * M_PI * 164.8 * t) *
+                                                           (0.5 + 0.5 * std::sin(2.0 * M_PI * 0.2 * t)));
+                    for (unsigned c = 0; c < channels; ++c) {
+                        lowpass[c] += 0.05f * (noise(rng) - lowpass[c]);
+                        buffer[c][i] = tone + 0.6f * lowpass[c];
+                    }
+                }
+                written += frames;
+            }
+            vorbis_analysis_wrote(&dsp, static_cast<int>(frames));
+
+            while (vorbis_analysis_blockout(&dsp, &block) == 1) {
+                vorbis_analysis(&block, nullptr);
+                vorbis_bitrate_addblock(&block);
+
+                ogg_packet packet;
+                while (vorbis_bitrate_flushpacket(&dsp, &packet) == 1) {
+                    ogg_stream_packetin(&stream, &packet);
+                    while (ogg_stream_pageout(&stream, &page) != 0) {
+                        appendPage(out, page);
+                        eos = ogg_page_eos(&page) != 0;
+                    }
+                }
+            }
+        }
+
+        ogg_stream_clear(&stream);
+        vorbis_block_clear(&block);
+        vorbis_dsp_clear(&dsp);
+        vorbis_comment_clear(&comment);
+        vorbis_info_clear(&info);
+        return out;
+    }
+
+} //ambient
\ No newline at end of file
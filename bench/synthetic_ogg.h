@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace ambient {
+
+    // Encodes a deterministic ambient-like signal (filtered noise under a
+    // few slow sines) as Ogg Vorbis in memory. Returns empty on failure.
+    std::vector<uint8_t> encodeSyntheticOgg(uint32_t sample_rate, unsigned channels, double seconds, float quality = 0.4f);
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "activity_detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace ambient {
+
+    // Fragments are rarely shorter than a few ms; this bounds the rings
+    // while leaving room for windows of several seconds.
+    static constexpr size_t MAX_WINDOW_ENTRIES = 4096;
+    static constexpr double MIN_FRAGMENT_MS = 1.0;
+
+    // Enough entries for a window of 1 ms fragments, within the bound.
+    static size_t peakRingSize(double window_ms) {
+        double entries = std::min(window_ms / MIN_FRAGMENT_MS, static_cast<double>(MAX_WINDOW_ENTRIES - 2));
+        return static_cast<size_t>(std::max(entries, 0.0)) + 2;
+    }
+
+    MeanDetector::MeanDetector(double window_ms) : ring(MAX_WINDOW_ENTRIES), window_ms(window_ms) {}
+
+    double MeanDetector::update(double level, double duration_ms) {
+        if (duration_ms <= 0.0) {
+            return count ? weighted_sum / total_ms : 0.0;
+        }
+
+        if (count == ring.size()) {
+            const Entry& oldest = ring[head];
+            weighted_sum -= oldest.weighted_level;
+            total_ms -= oldest.duration_ms;
+            head = (head + 1) % ring.size();
+            --count;
+        }
+
+        ring[(head + count) % ring.size()] = {level * duration_ms, duration_ms};
+        ++count;
+        weighted_sum += level * duration_ms;
+        total_ms += duration_ms;
+
+        // Always keep the newest fragment, even if it alone exceeds the window.
+        while (count > 1 && total_ms - ring[head].duration_ms >= window_ms) {
+            weighted_sum -= ring[head].weighted_level;
+            total_ms -= ring[head].duration_ms;
+            head = (head + 1) % ring.size();
+            --count;
+        }
+
+        return std::max(0.0, weighted_sum) / total_ms;
+    }
+
+    void MeanDetector::reset() {
+        head = 0;
+        count = 0;
+        weighted_sum = 0.0;
+        total_ms = 0.0;
+    }
+
+    EwmaDetector::EwmaDetector(double attack_ms, double release_ms)
+        : attack_ms(std::max(attack_ms, 0.001)), release_ms(std::max(release_ms, 0.001)) {}
+
+    double EwmaDetector::update(double level, double duration_ms) {
+        double tau = level > value ? attack_ms : release_ms;
+        double alpha = 1.0 - std::exp(-duration_ms / tau);
+        value += alpha * (level - value);
+        return value;
+    }
+
+    void EwmaDetector::reset() {
+        value = 0.0;
+    }
+
+    PeakHoldDetector::PeakHoldDetector(double window_ms) : ring(peakRingSize(window_ms)), window_ms(window_ms) {}
+
+    double PeakHoldDetector::update(double level, double duration_ms) {
+        now_ms += std::max(duration_ms, 0.0);
+
+        // Levels below the new one can never be the maximum again.
+        while (count > 0 && ring[(head + count - 1) % ring.size()].level <= level) {
+            --count;
+        }
+        if (count == ring.size()) {
+            // Out of room: the newest entry, which is louder, is held until
+            // now instead. That overstates the peak briefly, where dropping
+            // the oldest entry would lose the window's maximum.
+            ring[(head + count - 1) % ring.size()].time_ms = now_ms;
+        } else {
+            ring[(head + count) % ring.size()] = {level, now_ms};
+            ++count;
+        }
+
+        while (count > 1 && now_ms - ring[head].time_ms >= window_ms) {
+            head = (head + 1) % ring.size();
+            --count;
+        }
+
+        return ring[head].level;
+    }
+
+    void PeakHoldDetector::reset() {
+        head = 0;
+        count = 0;
+        now_ms = 0.0;
+    }
+
+    std::unique_ptr<ActivityDetector> makeActivityDetector(const DetectorSettings& settings) {
+        if (settings.type == "mean") {
+            return std::make_unique<MeanDetector>(settings.window_ms);
+        }
+        if (settings.type == "peak") {
+            return std::make_unique<PeakHoldDetector>(settings.window_ms);
+        }
+        if (settings.type != "ewma") {
+            std::cerr << "Unknown detector '" << settings.type << "', using ewma" << std::endl;
+        }
+        return std::make_unique<EwmaDetector>(settings.attack_ms, settings.release_ms);
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ambient {
+
+    struct DetectorSettings {
+        std::string type = "ewma";          // "mean", "ewma" or "peak"
+        double window_ms = 300.0;           // mean and peak window
+        double attack_ms = 10.0;            // ewma rise time constant
+        double release_ms = 400.0;          // ewma fall time constant
+        double activity_threshold = 0.0226; // level that counts as activity
+        double release_threshold = 0.012;   // level activity must drop below
+        int resume_delay_ms = 1000;         // quiet time before resuming
+    };
+
+    // Smooths per-fragment RMS levels into the value compared against the
+    // activity thresholds. update() is O(1) (amortised for windowed types).
+    class ActivityDetector {
+    public:
+        virtual ~ActivityDetector() = default;
+
+        virtual double update(double level, double duration_ms) = 0;
+        virtual void reset() = 0;
+    };
+
+    // Duration-weighted mean over a sliding window, kept as a running sum.
+    class MeanDetector : public ActivityDetector {
+    public:
+        explicit MeanDetector(double window_ms);
+
+        double update(double level, double duration_ms) override;
+        void reset() override;
+
+    private:
+        struct Entry {
+            double weighted_level;
+            double duration_ms;
+        };
+
+        std::vector<Entry> ring;
+        size_t head = 0;
+        size_t count = 0;
+        double window_ms;
+        double weighted_sum = 0.0;
+        double total_ms = 0.0;
+    };
+
+    // Exponential average that rises with the attack time constant and
+    // falls with the release one, so short gaps in speech do not register
+    // as silence.
+    class EwmaDetector : public ActivityDetector {
+    public:
+        EwmaDetector(double attack_ms, double release_ms);
+
+        double update(double level, double duration_ms) override;
+        void reset() override;
+
+    private:
+        double attack_ms;
+        double release_ms;
+        double value = 0.0;
+    };
+
+    // Highest level seen within the window (monotonic queue).
+    class PeakHoldDetector : public ActivityDetector {
+    public:
+        explicit PeakHoldDetector(double window_ms);
+
+        double update(double level, double duration_ms) override;
+        void reset() override;
+
+    private:
+        struct Entry {
+            double level;
+            double time_ms;
+        };
+
+        std::vector<Entry> ring;
+        size_t head = 0;
+        size_t count = 0;
+        double window_ms;
+        double now_ms = 0.0;
+    };
+
+    std::unique_ptr<ActivityDetector> makeActivityDetector(const DetectorSettings& settings);
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "activity_monitor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ambient {
+
+    ActivityMonitor::ActivityMonitor(const DetectorSettings& settings, MonitorBackend& backend)
+        : settings(settings), backend(backend), last_activity_time(backend.now()) {
+    }
+
+    void ActivityMonitor::onFragment(double mean_square, double duration_ms) {
+        onFragment(0, mean_square, duration_ms);
+    }
+
+    void ActivityMonitor::onFragment(uint32_t source, double mean_square, double duration_ms) {
+        double raw = std::sqrt(mean_square);
+
+        // The reaction clock starts with the first fragment that is loud on
+        // its own, before any smoothing; a blip that fades without causing a
+        // pause resets it.
+        if (!level_active) {
+            if (!onset_pending && raw > settings.activity_threshold) {
+                onset_pending = true;
+                onset_time = backend.now() - std::chrono::duration_cast<MonitorBackend::Clock::duration>(
+                                                 std::chrono::duration<double, std::milli>(duration_ms));
+            } else if (onset_pending && raw < settings.release_threshold) {
+                onset_pending = false;
+            }
+        }
+
+        auto it = std::find_if(sources.begin(), sources.end(), [source](const Source& s) { return s.id == source; });
+        if (it == sources.end()) {
+            sources.push_back({source, makeActivityDetector(settings), 0.0});
+            it = sources.end() - 1;
+        }
+        it->level = it->detector->update(raw, duration_ms);
+        updateLevel();
+        update();
+    }
+
+    void ActivityMonitor::removeSource(uint32_t source) {
+        auto it = std::find_if(sources.begin(), sources.end(), [source](const Source& s) { return s.id == source; });
+        if (it == sources.end()) {
+            return;
+        }
+        sources.erase(it);
+        updateLevel();
+        update();
+    }
+
+    void ActivityMonitor::updateLevel() {
+        level = 0.0;
+        for (const Source& s : sources) {
+            level = std::max(level, s.level);
+        }
+    }
+
+    // Fed through the level path as full scale or silence, so hysteresis
+    // and the resume delay behave as in monitor mode.
+    void ActivityMonitor::onStreamActivity(bool active) {
+        if (active && !level_active && !onset_pending) {
+            onset_pending = true;
+            onset_time = backend.now();
+        }
+        level = active ? 1.0 : 0.0;
+        update();
+    }
+
+    void ActivityMonitor::onResumeTimer() {
+        update();
+    }
+
+    void ActivityMonitor::reset() {
+        for (Source& s : sources) {
+            s.detector->reset();
+            s.level = 0.0;
+        }
+        level = 0.0;
+        level_active = false;
+        system_was_active = false;
+        onset_pending = false;
+        backend.cancelResumeTimer();
+    }
+
+    void ActivityMonitor::setSettings(const DetectorSettings& settings) {
+        this->settings = settings;
+        for (Source& s : sources) {
+            s.detector = makeActivityDetector(settings);
+            s.level = 0.0;
+        }
+    }
+
+    double ActivityMonitor::getLevel() const {
+        return level;
+    }
+
+    MonitorBackend::Clock::duration ActivityMonitor::getReactionTime() const {
+        return reaction_time;
+    }
+
+    void ActivityMonitor::update() {
+        // Hysteresis: once active, the level has to fall below the lower
+        // release threshold before the quiet period starts counting.
+        if (level > settings.activity_threshold) {
+            level_active = true;
+        } else if (level < settings.release_threshold) {
+            level_active = false;
+        }
+
+        if (level_active) {
+            last_activity_time = backend.now();
+            system_was_active = true;
+            backend.cancelResumeTimer();
+
+            if (backend.isPlaying()) {
+                reaction_time = onset_pending ? backend.now() - onset_time : MonitorBackend::Clock::duration::zero();
+                backend.pause();
+            }
+            onset_pending = false;
+        } else if (system_was_active) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(backend.now() - last_activity_time);
+            auto delay = std::chrono::microseconds(static_cast<int64_t>(settings.resume_delay_ms) * 1000);
+
+            if (elapsed >= delay) {
+                if (!backend.isPlaying()) {
+                    backend.play();
+                }
+                system_was_active = false;
+            } else {
+                backend.armResumeTimer(delay - elapsed);
+            }
+        } else if (!backend.isPlaying()) {
+            backend.play();
+        }
+    }
+
+} //ambient
\ No newline at end of file
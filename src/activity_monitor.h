@@ -0,0 +1,88 @@
+#pragma once
+
+#include "activity_detector.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ambient {
+
+    // What the pause/resume logic needs from the sound server and the
+    // player. The service implements it on libpulse, the latency bench on a
+    // virtual clock with scripted input.
+    class MonitorBackend {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        virtual ~MonitorBackend() = default;
+
+        virtual Clock::time_point now() const = 0;
+
+        // Calls ActivityMonitor::onResumeTimer() once `delay` from now;
+        // arming again replaces the pending call.
+        virtual void armResumeTimer(std::chrono::microseconds delay) = 0;
+        virtual void cancelResumeTimer() = 0;
+
+        virtual bool isPlaying() const = 0;
+        virtual void play() = 0;
+        virtual void pause() = 0;
+    };
+
+    // Turns capture fragments or stream-state changes into pause and resume
+    // decisions: detector smoothing, threshold hysteresis and the quiet
+    // period required before resuming.
+    class ActivityMonitor {
+    public:
+        ActivityMonitor(const DetectorSettings& settings, MonitorBackend& backend);
+
+        // One capture fragment; `mean_square` is normalised to full scale
+        // with our own output already taken out.
+        void onFragment(double mean_square, double duration_ms);
+        // The same from one of several captures (one per sink). Each source
+        // is smoothed on its own and the loudest one decides.
+        void onFragment(uint32_t source, double mean_square, double duration_ms);
+        // Forgets a source that stopped sending, so its last level no
+        // longer counts.
+        void removeSource(uint32_t source);
+
+        // Stream-state detection: whether any foreign stream is playing.
+        void onStreamActivity(bool active);
+
+        void onResumeTimer();
+        void reset();
+
+        // New thresholds and detector; the detector restarts from silence.
+        void setSettings(const DetectorSettings& settings);
+
+        double getLevel() const;
+
+        // From the start of the first loud fragment to the pause it led to;
+        // set just before MonitorBackend::pause() is called.
+        MonitorBackend::Clock::duration getReactionTime() const;
+
+    private:
+        struct Source {
+            uint32_t id;
+            std::unique_ptr<ActivityDetector> detector;
+            double level;
+        };
+
+        void update();
+        void updateLevel();
+
+        DetectorSettings settings;
+        MonitorBackend& backend;
+        std::vector<Source> sources;
+
+        double level = 0.0;
+        bool level_active = false;
+        bool system_was_active = false;
+        MonitorBackend::Clock::time_point last_activity_time;
+        MonitorBackend::Clock::time_point onset_time;
+        bool onset_pending = false;
+        MonitorBackend::Clock::duration reaction_time{0};
+    };
+
+} //ambient
\ No newline at end of file
@@ -1,15 +1,25 @@
 #include "audio_controller.h"
+#include "trace.h"
 #include <string.h>
-#include <pulse/glib-mainloop.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <pulse/rtclock.h>
 #include <pulse/volume.h>
 #include <pulse/ext-stream-restore.h>
 #include <pulse/error.h>
+#include <cerrno>
 #include <cmath>
 #include <algorithm>
+#include <sstream>
+#include <vector>
 
 namespace ambient{
 
-    AudioController::AudioController() : last_activity_time(std::chrono::steady_clock::now()) {
+    AudioController::AudioController(const Config& config)
+        : config(config), activity(config.detector, *this) {
+        metrics_path = config.metrics_file.empty() ? MetricsRegistry::defaultPath() : config.metrics_file;
+        findLatencyProfile(config.latency_profile, latency);
+        player.registerMetrics(metrics);
         if(!init()) throw std::runtime_error("Audio controller not inited");
     };
 
@@ -18,40 +28,105 @@ namespace ambient{
     }
 
     bool AudioController::init() {
-        return player.init();
+        pa_sample_spec sink_spec;
+        if (config.resample && queryDefaultSinkSpec(sink_spec)) {
+            std::cout << "Default sink plays " << pa_sample_format_to_string(sink_spec.format) << " at "
+                      << sink_spec.rate << " Hz; converting tracks to match" << std::endl;
+            return player.init(config, &sink_spec);
+        }
+        return player.init(config);
+    }
+
+    // Asks the server for the default sink's sample spec on a short-lived
+    // connection, before the reactor exists. False if there is no server.
+    bool AudioController::queryDefaultSinkSpec(pa_sample_spec& spec) {
+        struct Query {
+            pa_sample_spec spec;
+            bool found = false;
+        } query;
+
+        pa_mainloop* temp_ml = pa_mainloop_new();
+        pa_mainloop_api* temp_mlapi = pa_mainloop_get_api(temp_ml);
+        pa_context* temp_ctx = pa_context_new(temp_mlapi, "desktop_ambient_probe");
+
+        pa_context_state_t state = PA_CONTEXT_FAILED;
+        if (pa_context_connect(temp_ctx, nullptr, PA_CONTEXT_NOAUTOSPAWN, nullptr) >= 0) {
+            do {
+                pa_mainloop_iterate(temp_ml, 1, nullptr);
+                state = pa_context_get_state(temp_ctx);
+            } while (state != PA_CONTEXT_READY && state != PA_CONTEXT_FAILED && state != PA_CONTEXT_TERMINATED);
+        }
+
+        if (state == PA_CONTEXT_READY) {
+            pa_operation* op = pa_context_get_sink_info_by_name(temp_ctx, "@DEFAULT_SINK@",
+                []([[maybe_unused]]pa_context* c, const pa_sink_info* i, int eol, void* userdata) {
+                    auto* query = static_cast<Query*>(userdata);
+                    if (!eol && i) {
+                        query->spec = i->sample_spec;
+                        query->found = true;
+                    }
+                },
+                &query
+            );
+
+            if (op) {
+                while (pa_operation_get_state(op) == PA_OPERATION_RUNNING) {
+                    pa_mainloop_iterate(temp_ml, 1, nullptr);
+                }
+                pa_operation_unref(op);
+            }
+        }
+
+        pa_context_disconnect(temp_ctx);
+        pa_context_unref(temp_ctx);
+        pa_mainloop_free(temp_ml);
+
+        if (query.found) {
+            spec = query.spec;
+        }
+        return query.found;
     }
 
     void AudioController::start() {
         if (running) return;
         
+        monitor_mainloop = pa_mainloop_new();
+        if (!monitor_mainloop) {
+            std::cerr << "Failed to create monitor mainloop" << std::endl;
+            return;
+        }
+        
+        command_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (command_fd < 0) {
+            std::cerr << "Failed to create command eventfd, control commands disabled" << std::endl;
+        }
+        failure_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        
         running = true;
         player.play();
-        monitor_thread = std::thread(&AudioController::monitorAudioActivity, this);
-        system_monitor_thread = std::thread(&AudioController::monitorSystemOutput, this);
+        monitor_thread = std::thread(&AudioController::monitorSystemOutput, this);
     }
 
     void AudioController::stop() {
         running = false;
-        player.stop();
+        
+        if (monitor_mainloop) {
+            pa_mainloop_wakeup(monitor_mainloop);
+        }
         
         if (monitor_thread.joinable()) {
             monitor_thread.join();
         }
         
-        if (system_monitor_thread.joinable()) {
-            system_monitor_thread.join();
-        }
+        player.stop();
         
-        if (monitor_stream) {
-            pa_stream_disconnect(monitor_stream);
-            pa_stream_unref(monitor_stream);
-            monitor_stream = nullptr;
+        if (command_fd >= 0) {
+            close(command_fd);
+            command_fd = -1;
         }
-        
-        if (monitor_context) {
-            pa_context_disconnect(monitor_context);
-            pa_context_unref(monitor_context);
-            monitor_context = nullptr;
+        if (failure_fd >= 0) {
+            close(failure_fd);
+            failure_fd = -1;
         }
         
         if (monitor_mainloop) {
@@ -64,16 +139,38 @@ namespace ambient{
         auto* controller = static_cast<AudioController*>(userdata);
         
         switch (pa_context_get_state(c)) {
-            case PA_CONTEXT_READY:
-                pa_context_subscribe(c, static_cast<pa_subscription_mask_t>(
-                    PA_SUBSCRIPTION_MASK_SINK_INPUT | 
-                    PA_SUBSCRIPTION_MASK_SINK), 
-                    nullptr, nullptr);
-                pa_context_get_sink_info_list(c, sinkInfoCallback, userdata);
+            case PA_CONTEXT_READY: {
+                if (controller->config.detection_mode != "streams") {
+                    controller->player.setSinkChangedHandler([controller] { controller->updateOurSink(); });
+                }
+                controller->player.attachStream(c);
+                controller->exportMetrics();
+                std::vector<pa_operation*> ops;
+                if (controller->config.detection_mode == "streams") {
+                    ops.push_back(pa_context_subscribe(c, PA_SUBSCRIPTION_MASK_SINK_INPUT, nullptr, nullptr));
+                    ops.push_back(pa_context_get_sink_input_info_list(c, sinkInputInfoCallback, userdata));
+                } else {
+                    // The server info reply comes first, so the default sink
+                    // is known before the sinks are listed.
+                    ops.push_back(pa_context_subscribe(
+                        c, static_cast<pa_subscription_mask_t>(PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SERVER),
+                        nullptr, nullptr));
+                    ops.push_back(pa_context_get_server_info(c, serverInfoCallback, userdata));
+                    ops.push_back(pa_context_get_sink_info_list(c, sinkInfoCallback, userdata));
+                }
+                for (pa_operation* op : ops) {
+                    if (op) pa_operation_unref(op);
+                }
                 break;
+            }
+            // Our own disconnect on stop() also ends here, with running
+            // already cleared.
             case PA_CONTEXT_FAILED:
             case PA_CONTEXT_TERMINATED:
-                controller->stop();
+                if (controller->running) {
+                    std::cerr << "Monitor context failed or terminated" << std::endl;
+                    controller->reportFailure();
+                }
                 break;
             default:
                 break;
@@ -81,244 +178,631 @@ namespace ambient{
     }
 
     void AudioController::subscribeCallback(pa_context* c, pa_subscription_event_type_t t, uint32_t idx, void* userdata) {
+        auto* controller = static_cast<AudioController*>(userdata);
+        const auto facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+        
         switch (t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) {
             case PA_SUBSCRIPTION_EVENT_NEW:
-            case PA_SUBSCRIPTION_EVENT_CHANGE:
-                if (t & PA_SUBSCRIPTION_EVENT_SINK_INPUT) {
-                    pa_context_get_sink_input_info(c, idx, sinkInputInfoCallback, userdata);
-                } else if (t & PA_SUBSCRIPTION_EVENT_SINK) {
-                    pa_context_get_sink_info_by_index(c, idx, sinkInfoCallback, userdata);
+            case PA_SUBSCRIPTION_EVENT_CHANGE: {
+                pa_operation* op = nullptr;
+                if (facility == PA_SUBSCRIPTION_EVENT_SINK_INPUT) {
+                    op = pa_context_get_sink_input_info(c, idx, sinkInputInfoCallback, userdata);
+                } else if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
+                    op = pa_context_get_sink_info_by_index(c, idx, sinkInfoCallback, userdata);
+                } else if (facility == PA_SUBSCRIPTION_EVENT_SERVER) {
+                    op = pa_context_get_server_info(c, serverInfoCallback, userdata);
+                }
+                if (op) pa_operation_unref(op);
+                break;
+            }
+            case PA_SUBSCRIPTION_EVENT_REMOVE:
+                if (facility == PA_SUBSCRIPTION_EVENT_SINK_INPUT && controller->sink_inputs.erase(idx)) {
+                    controller->updateStreamActivity();
+                } else if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
+                    auto it = controller->sinks.find(idx);
+                    if (it != controller->sinks.end()) {
+                        std::cout << "Sink " << it->second->name << " removed" << std::endl;
+                        controller->closeSinkMonitor(*it->second);
+                        controller->sinks.erase(it);
+                        controller->updateActiveSinks();
+                        controller->activity.removeSource(idx);
+                    }
                 }
                 break;
         }
     }
 
-    void AudioController::sinkInputInfoCallback([[maybe_unused]]pa_context* c, [[maybe_unused]]const pa_sink_input_info* i, [[maybe_unused]]int eol, [[maybe_unused]]void* userdata) {
-        return;
+    // Our own playback, whichever backend created it, is recognised by
+    // process id first and by the names the service runs under otherwise.
+    static bool isOwnStream(const pa_sink_input_info* i) {
+        if (!i->proplist) {
+            return false;
+        }
+        
+        const char* pid = pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_PROCESS_ID);
+        if (pid && std::to_string(getpid()) == pid) {
+            return true;
+        }
+        
+        const char* app_name = pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME);
+        const char* process_binary = pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_PROCESS_BINARY);
+        
+        if (app_name && strstr(app_name, "desktop_ambient") != nullptr) {
+            return true;
+        }
+        return process_binary && (
+            strstr(process_binary, "desktop_ambient") != nullptr ||
+            strstr(process_binary, "audio_controller") != nullptr);
     }
 
+    void AudioController::sinkInputInfoCallback([[maybe_unused]]pa_context* c, const pa_sink_input_info* i, int eol, void* userdata) {
+        auto* controller = static_cast<AudioController*>(userdata);
+        
+        if (eol || !i) {
+            controller->updateStreamActivity();
+            return;
+        }
+        
+        if (isOwnStream(i)) {
+            return;
+        }
+        
+        auto it = controller->sink_inputs.find(i->index);
+        bool playing = !i->corked;
+        if (it == controller->sink_inputs.end() || it->second != playing) {
+            const char* app_name = i->proplist ? pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME) : nullptr;
+            std::cout << "Sink input " << i->index << " (" << (app_name ? app_name : i->name ? i->name : "unknown")
+                      << ") " << (playing ? "playing" : "corked") << std::endl;
+        }
+        controller->sink_inputs[i->index] = playing;
+    }
+
+    // Stream-state detection: any uncorked foreign sink input counts as
+    // activity.
+    void AudioController::updateStreamActivity() {
+        bool active = std::any_of(sink_inputs.begin(), sink_inputs.end(),
+                                  [](const auto& entry) { return entry.second; });
+        activity.onStreamActivity(active);
+        status_level.store(activity.getLevel(), std::memory_order_relaxed);
+    }
+
+    // Adds sinks to the registry and corks the monitor of any sink with
+    // nothing to play; an existing stream is only reopened when the peak
+    // profile needs a different capture.
     void AudioController::sinkInfoCallback([[maybe_unused]]pa_context* c, const pa_sink_info* i, int eol, void* userdata) {
         auto* controller = static_cast<AudioController*>(userdata);
         
-        if (eol) {
+        if (eol || !i || !i->monitor_source_name) {
             return;
         }
         
-        if (i->monitor_source_name && (i->flags & PA_SINK_HW_VOLUME_CTRL)) {
-            controller->setupMonitorStream();
+        auto& entry = controller->sinks[i->index];
+        if (!entry) {
+            entry = std::make_unique<SinkMonitor>();
+            entry->controller = controller;
+            entry->index = i->index;
+        }
+        SinkMonitor& sink = *entry;
+        sink.name = i->name;
+        sink.is_ours = controller->carriesOurTrack(sink);
+        
+        bool idle = i->state != PA_SINK_RUNNING;
+        if (!sink.stream) {
+            sink.corked = idle;
+            controller->openSinkMonitor(sink, i);
+        } else if (idle != sink.corked) {
+            sink.corked = idle;
+            pa_operation* op = pa_stream_cork(sink.stream, idle, nullptr, nullptr);
+            if (op) pa_operation_unref(op);
+        }
+        controller->updateActiveSinks();
+        
+        if (idle) {
+            controller->activity.removeSource(sink.index);
         }
     }
 
-    void AudioController::streamReadCallback(pa_stream* s, size_t length, void* userdata) {
+    // Only matters for the simple backend, whose track follows the default
+    // sink; the stream backend reports its own sink.
+    void AudioController::serverInfoCallback([[maybe_unused]]pa_context* c, const pa_server_info* i, void* userdata) {
         auto* controller = static_cast<AudioController*>(userdata);
-        const void* data;
         
-        if (gIsOurAudioPlaying) {
-            pa_stream_drop(s);
-            controller->current_system_volume = 0.0;
+        if (!i || !i->default_sink_name || controller->default_sink == i->default_sink_name) {
             return;
         }
         
+        controller->default_sink = i->default_sink_name;
+        std::cout << "Default sink is " << controller->default_sink << std::endl;
+        controller->updateOurSink();
+    }
+
+    void AudioController::streamReadCallback(pa_stream* s, size_t length, void* userdata) {
+        auto* sink = static_cast<SinkMonitor*>(userdata);
+        auto* controller = sink->controller;
+        const void* data;
+        
         if (pa_stream_peek(s, &data, &length) < 0) {
             std::cerr << "Failed to read data from monitor stream" << std::endl;
             return;
         }
         
-        if (length > 0 && data) {
-            double volume = 0.0;
-            
-            const int16_t* samples = static_cast<const int16_t*>(data);
-            size_t sample_count = length / sizeof(int16_t) / 2;
-            
-            for (size_t i = 0; i < sample_count * 2; i += 2) {
-                double left = samples[i] / 32768.0;
-                double right = samples[i + 1] / 32768.0;
-                volume += (left * left + right * right) / 4.0;
+        if (length == 0) {
+            return;
+        }
+        
+        AMBIENT_TRACE_SCOPE("monitor_fragment");
+        const size_t channels = sink->channels;
+        const size_t frame_size = bytesPerSample(sink->format) * channels;
+        const size_t samples = length / frame_size * channels;
+        
+        auto dsp_start = std::chrono::steady_clock::now();
+        
+        if (data && samples > 0) {
+            double mean_square = sink->loudness_kernel(data, samples);
+            if (sink->peak) {
+                mean_square /= PEAK_POWER_RATIO;
             }
             
-            volume = std::sqrt(volume / sample_count);
-            
-            controller->volume_history.push_back(volume);
-            if (controller->volume_history.size() > HISTORY_SIZE) {
-                controller->volume_history.pop_front();
+            // Take out the part of the fragment that is our own track, so
+            // other applications on our sink are heard while we play. The
+            // reference frame being mixed now, less the time the fragment
+            // spent in the record buffer, lines up with the fragment's end.
+            const OutputReference& reference = controller->player.getReference();
+            int64_t mixed_frame = 0;
+            pa_usec_t latency = 0;
+            int negative = 0;
+            if (sink->is_ours && !sink->peak && reference.mixedFrame(mixed_frame)) {
+                if (pa_stream_get_latency(s, &latency, &negative) < 0 || negative) {
+                    latency = 0;
+                }
+                int64_t end_frame = mixed_frame - static_cast<int64_t>(latency * reference.getSampleRate() / 1000000);
+                mean_square *= 1.0 - sink->canceller.explainedFraction(data, samples / channels, reference, end_frame);
+                
+                // Interpolation carries the latency until the next fragment.
+                pa_operation* op = pa_stream_update_timing_info(s, nullptr, nullptr);
+                if (op) pa_operation_unref(op);
             }
             
-            double avg_volume = 0.0;
-            for (double v : controller->volume_history) {
-                avg_volume += v;
-            }
-            avg_volume /= controller->volume_history.size();
+            double duration_ms = 1000.0 * (samples / channels) / sink->rate;
             
-            controller->current_system_volume = avg_volume;
+            controller->activity.onFragment(sink->index, mean_square, duration_ms);
+            controller->status_level.store(controller->activity.getLevel(), std::memory_order_relaxed);
         }
         
         pa_stream_drop(s);
+        
+        controller->monitor_callbacks.add();
+        controller->monitor_bytes.add(length);
+        controller->monitor_dsp_seconds.observe(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - dsp_start).count());
     }
 
-    void AudioController::streamStateCallback(pa_stream* s, [[maybe_unused]]void* userdata) {      
+    void AudioController::streamStateCallback(pa_stream* s, void* userdata) {
+        auto* sink = static_cast<SinkMonitor*>(userdata);
+        
         switch (pa_stream_get_state(s)) {
             case PA_STREAM_READY:
-                std::cout << "Monitor stream ready" << std::endl;
+                if (const pa_buffer_attr* attr = pa_stream_get_buffer_attr(s)) {
+                    std::cout << "Monitor stream for " << sink->name << " ready: "
+                              << describeBufferAttr(*attr, *pa_stream_get_sample_spec(s), false) << std::endl;
+                } else {
+                    std::cout << "Monitor stream for " << sink->name << " ready" << std::endl;
+                }
                 break;
+            // Dropped, so the sink's next event opens a fresh stream.
             case PA_STREAM_FAILED:
-                std::cerr << "Monitor stream failed" << std::endl;
+                std::cerr << "Monitor stream for " << sink->name << " failed" << std::endl;
+                sink->controller->closeSinkMonitor(*sink);
+                sink->controller->activity.removeSource(sink->index);
+                sink->controller->updateActiveSinks();
                 break;
             case PA_STREAM_TERMINATED:
-                std::cout << "Monitor stream terminated" << std::endl;
+                std::cout << "Monitor stream for " << sink->name << " terminated" << std::endl;
                 break;
             default:
                 break;
         }
     }
 
-    bool AudioController::setupMonitorStream() {
-        pa_operation* op = pa_context_get_sink_info_by_name(monitor_context, 
-                                                          "@DEFAULT_SINK@", 
-                                                          [](pa_context* c, const pa_sink_info* i, int eol, void* userdata) {
-            auto* controller = static_cast<AudioController*>(userdata);
-            
-            if (eol || !i) {
-                return;
-            }
-            
-            pa_sample_spec ss;
-            ss.format = PA_SAMPLE_S16LE;
-            ss.rate = 44100;
-            ss.channels = 2;
-            
-            pa_buffer_attr attr;
-            attr.maxlength = static_cast<uint32_t>(-1);
-            attr.tlength = static_cast<uint32_t>(-1);
-            attr.prebuf = static_cast<uint32_t>(-1);
-            attr.minreq = static_cast<uint32_t>(-1);
-            attr.fragsize = static_cast<uint32_t>(-1);
-            
-            controller->monitor_stream = pa_stream_new(c, "System Output Monitor", &ss, nullptr);
-            pa_stream_set_state_callback(controller->monitor_stream, streamStateCallback, controller);
-            pa_stream_set_read_callback(controller->monitor_stream, streamReadCallback, controller);
-            
-            if (pa_stream_connect_record(controller->monitor_stream, i->monitor_source_name, &attr, 
-                                        static_cast<pa_stream_flags_t>(PA_STREAM_PEAK_DETECT | PA_STREAM_ADJUST_LATENCY)) < 0) {
-                std::cerr << "Failed to connect monitor stream: " << pa_strerror(pa_context_errno(c)) << std::endl;
-                return;
+    // native: record in the sink's own spec so the server does not convert;
+    // formats the loudness kernel lacks are requested as float. lowrate: the
+    // server downmixes to mono float and decimates, and sends one fragment
+    // per detector window. peak: sinks that do not carry our track have
+    // nothing to cancel, so the server sends only the peak of each
+    // 1/PEAK_RATE s block; ours records as in lowrate. Fragments are never
+    // shorter than the latency profile's.
+    void AudioController::openSinkMonitor(SinkMonitor& sink, const pa_sink_info* i) {
+        pa_sample_spec ss = i->sample_spec;
+        pa_channel_map map = i->channel_map;
+        int fragment_ms = latency.fragment_ms;
+        
+        sink.peak = wantsPeak(sink);
+        if (config.monitor_profile == "native") {
+            if (!toSampleFormat(ss.format, sink.format)) {
+                ss.format = PA_SAMPLE_FLOAT32LE;
+                sink.format = SampleFormat::Float32LE;
             }
-        }, this);
+        } else {
+            ss.format = PA_SAMPLE_FLOAT32LE;
+            ss.channels = 1;
+            ss.rate = sink.peak ? PEAK_RATE : std::min(static_cast<uint32_t>(config.monitor_rate), ss.rate);
+            pa_channel_map_init_mono(&map);
+            sink.format = SampleFormat::Float32LE;
+            fragment_ms = std::max(fragment_ms, static_cast<int>(config.detector.window_ms));
+        }
+        pa_buffer_attr attr = recordBufferAttr(fragment_ms, ss);
+        sink.channels = ss.channels;
+        sink.rate = ss.rate;
+        sink.loudness_kernel = selectLoudnessKernel(sink.format);
+        sink.canceller.setFormat(sink.format, ss.channels, ss.rate);
+        
+        std::cout << "Monitoring " << i->monitor_source_name << " as "
+                  << sampleFormatName(sink.format) << " " << ss.rate << " Hz, "
+                  << (int)ss.channels << " channels" << (sink.peak ? ", peaks" : "")
+                  << (sink.corked ? ", idle" : "") << " (" << simdLevelName(detectSimdLevel()) << ")" << std::endl;
+        
+        // The monitor must not keep an idle sink awake, and starts corked
+        // when the sink has nothing to play. Timing is only requested by
+        // the read callback where cancellation needs it, so a corked stream
+        // gets no periodic round trips.
+        int flags = PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_DONT_INHIBIT_AUTO_SUSPEND;
+        if (sink.peak) {
+            flags |= PA_STREAM_PEAK_DETECT;
+        }
+        if (sink.corked) {
+            flags |= PA_STREAM_START_CORKED;
+        }
+        
+        sink.stream = pa_stream_new(monitor_context, "System Output Monitor", &ss, &map);
+        if (!sink.stream) {
+            std::cerr << "Failed to create monitor stream for " << sink.name << ": "
+                      << pa_strerror(pa_context_errno(monitor_context)) << std::endl;
+            return;
+        }
+        pa_stream_set_state_callback(sink.stream, streamStateCallback, &sink);
+        pa_stream_set_read_callback(sink.stream, streamReadCallback, &sink);
         
-        pa_operation_unref(op);
-        return true;
+        if (pa_stream_connect_record(sink.stream, i->monitor_source_name, &attr, static_cast<pa_stream_flags_t>(flags)) < 0) {
+            std::cerr << "Failed to connect monitor stream: " << pa_strerror(pa_context_errno(monitor_context)) << std::endl;
+            closeSinkMonitor(sink);
+        }
     }
 
-    void AudioController::updateAudioActivity(double system_volume) {
-        bool is_active = system_volume > VOLUME_THRESHOLD;
-        
-        if (is_active) {
-            last_activity_time = std::chrono::steady_clock::now();
-            system_was_active = true;
-            
-            if (player.isPlaying()) {
-                std::cout << "System audio active (" << system_volume << "), pausing playback" << std::endl;
-                player.pause();
-            }
-        } else if (system_was_active) {
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_activity_time).count();
-
-            if (elapsed >= RESUME_DELAY_MS && !is_active) {
-                if (!player.isPlaying()) {
-                    std::cout << "System audio inactive for " << elapsed << "ms (" << system_volume << "), resuming playback" << std::endl;
-                    player.play();
-                }
-                system_was_active = false;
-            }
-        } else {
-            if (!player.isPlaying() && !system_was_active) {
-                std::cout << "System audio inactive (" << system_volume << "), resuming playback" << std::endl;
-                player.play();
+    void AudioController::closeSinkMonitor(SinkMonitor& sink) {
+        if (!sink.stream) {
+            return;
+        }
+        pa_stream_set_read_callback(sink.stream, nullptr, nullptr);
+        pa_stream_set_state_callback(sink.stream, nullptr, nullptr);
+        pa_stream_disconnect(sink.stream);
+        pa_stream_unref(sink.stream);
+        sink.stream = nullptr;
+        sink.canceller.reset();
+    }
+
+    // The stream backend knows its sink, which stream-restore or the user
+    // may have chosen over the default; the simple backend plays on the
+    // default sink.
+    bool AudioController::carriesOurTrack(const SinkMonitor& sink) const {
+        uint32_t index = player.getSinkIndex();
+        if (index != PA_INVALID_INDEX) {
+            return sink.index == index;
+        }
+        return sink.name == default_sink;
+    }
+
+    // Our own track moved, and with it the cancellation and, in the peak
+    // profile, the choice of capture.
+    void AudioController::updateOurSink() {
+        for (auto& [index, sink] : sinks) {
+            sink->is_ours = carriesOurTrack(*sink);
+            if (!sink->is_ours) {
+                sink->canceller.reset();
             }
         }
+        updateMonitorProfile();
+    }
+
+    // Peaks cannot be cancelled, so the sink carrying our own track records
+    // the waveform, paused or not: play and pause then never reopen a
+    // stream, and monitoring has no gaps around them.
+    bool AudioController::wantsPeak(const SinkMonitor& sink) const {
+        return config.monitor_profile == "peak" && !sink.is_ours;
     }
 
-    void AudioController::monitorAudioActivity() {
-        pa_glib_mainloop* mainloop = pa_glib_mainloop_new(nullptr);
-        if (!mainloop) {
-            std::cerr << "Failed to create PulseAudio mainloop" << std::endl;
+    // Reopens the streams whose capture no longer fits once our track has
+    // moved to another sink. Never called from a read callback.
+    void AudioController::updateMonitorProfile() {
+        if (config.monitor_profile != "peak") {
             return;
         }
         
-        pa_context* context = pa_context_new(pa_glib_mainloop_get_api(mainloop), "desktop_ambient_monitor");
-        if (!context) {
-            std::cerr << "Failed to create PulseAudio context" << std::endl;
-            pa_glib_mainloop_free(mainloop);
+        for (auto& [index, sink] : sinks) {
+            if (sink->stream && sink->peak != wantsPeak(*sink)) {
+                closeSinkMonitor(*sink);
+                pa_operation* op = pa_context_get_sink_info_by_index(monitor_context, index, sinkInfoCallback, this);
+                if (op) pa_operation_unref(op);
+            }
+        }
+    }
+
+    void AudioController::updateActiveSinks() {
+        size_t active = std::count_if(sinks.begin(), sinks.end(), [](const auto& entry) {
+            return entry.second->stream && !entry.second->corked;
+        });
+        active_sinks.set(static_cast<double>(active));
+    }
+
+    // Reactor: owns the PulseAudio context carrying the monitor stream and,
+    // with the stream backend, playback. It blocks in poll() until the
+    // server sends data or events, the resume timer expires or stop()
+    // wakes it up, so an idle service does not wake the CPU.
+    void AudioController::monitorSystemOutput() {
+        AMBIENT_TRACE_THREAD("reactor");
+        pa_mainloop_api* api = pa_mainloop_get_api(monitor_mainloop);
+        
+        monitor_context = pa_context_new(api, "desktop_ambient_monitor");
+        if (!monitor_context) {
+            std::cerr << "Failed to create monitor context" << std::endl;
+            reportFailure();
             return;
         }
         
-        pa_context_set_state_callback(context, contextStateCallback, this);
-        pa_context_set_subscribe_callback(context, subscribeCallback, this);
+        pa_io_event* command_event = nullptr;
+        if (command_fd >= 0) {
+            command_event = api->io_new(api, command_fd, PA_IO_EVENT_INPUT, commandCallback, this);
+        }
+        
+        pa_context_set_state_callback(monitor_context, contextStateCallback, this);
+        pa_context_set_subscribe_callback(monitor_context, subscribeCallback, this);
         
-        if (pa_context_connect(context, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0) {
-            std::cerr << "Failed to connect PulseAudio context" << std::endl;
-            pa_context_unref(context);
-            pa_glib_mainloop_free(mainloop);
+        if (pa_context_connect(monitor_context, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0) {
+            std::cerr << "Failed to connect monitor context" << std::endl;
+            pa_context_unref(monitor_context);
+            monitor_context = nullptr;
+            reportFailure();
             return;
         }
         
-        GMainContext* glib_context = g_main_context_new();
-        GMainLoop* loop = g_main_loop_new(glib_context, FALSE);
-        
         while (running) {
-            g_main_context_iteration(glib_context, FALSE);
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            if (pa_mainloop_iterate(monitor_mainloop, 1, nullptr) < 0) {
+                if (running) {
+                    reportFailure();
+                }
+                break;
+            }
+        }
+        
+        if (resume_timer) {
+            api->time_free(resume_timer);
+            resume_timer = nullptr;
+        }
+        
+        if (command_event) {
+            api->io_free(command_event);
+        }
+        
+        if (metrics_timer) {
+            api->time_free(metrics_timer);
+            metrics_timer = nullptr;
+            unlink(metrics_path.c_str());
         }
         
-        g_main_loop_unref(loop);
-        pa_context_unref(context);
-        pa_glib_mainloop_free(mainloop);
+        for (auto& [index, sink] : sinks) {
+            closeSinkMonitor(*sink);
+        }
+        sinks.clear();
+        updateActiveSinks();
+        
+        player.detachStream();
+        player.setSinkChangedHandler(nullptr);
+        pa_context_disconnect(monitor_context);
+        pa_context_unref(monitor_context);
+        monitor_context = nullptr;
     }
 
-    void AudioController::monitorSystemOutput() {
-        monitor_mainloop = pa_mainloop_new();
-        if (!monitor_mainloop) {
-            std::cerr << "Failed to create monitor mainloop" << std::endl;
+    // The reactor cannot go on without the server: stops it and wakes main
+    // through failure_fd, so the process exits and the unit restarts it.
+    void AudioController::reportFailure() {
+        running = false;
+        if (failure_fd >= 0) {
+            uint64_t one = 1;
+            if (write(failure_fd, &one, sizeof(one)) < 0) {
+                std::cerr << "Failed to signal reactor failure: " << strerror(errno) << std::endl;
+            }
+        }
+    }
+
+    int AudioController::getFailureFd() const {
+        return failure_fd;
+    }
+
+    void AudioController::resumeTimerCallback([[maybe_unused]]pa_mainloop_api* api, [[maybe_unused]]pa_time_event* e,
+                                              [[maybe_unused]]const struct timeval* tv, void* userdata) {
+        auto* controller = static_cast<AudioController*>(userdata);
+        controller->activity.onResumeTimer();
+    }
+
+    void AudioController::metricsTimerCallback([[maybe_unused]]pa_mainloop_api* api, [[maybe_unused]]pa_time_event* e,
+                                               [[maybe_unused]]const struct timeval* tv, void* userdata) {
+        static_cast<AudioController*>(userdata)->exportMetrics();
+    }
+
+    // Rewrites the metrics file every metrics_interval_ms on the reactor;
+    // the file lives in the runtime directory, which is tmpfs.
+    void AudioController::exportMetrics() {
+        if (metrics_path.empty() || config.metrics_interval_ms <= 0 || !monitor_context) {
             return;
         }
         
-        monitor_context = pa_context_new(pa_mainloop_get_api(monitor_mainloop), "system_output_monitor");
-        if (!monitor_context) {
-            std::cerr << "Failed to create monitor context" << std::endl;
-            pa_mainloop_free(monitor_mainloop);
-            return;
+        std::string error;
+        if (!metrics.writeFile(metrics_path, error)) {
+            std::cerr << "Failed to write metrics to " << metrics_path << ": " << error << std::endl;
         }
         
-        pa_context_set_state_callback(monitor_context, [](pa_context* c, void* userdata) {
-            auto* controller = static_cast<AudioController*>(userdata);
-            
-            switch (pa_context_get_state(c)) {
-                case PA_CONTEXT_READY:
-                    controller->setupMonitorStream();
-                    break;
-                case PA_CONTEXT_FAILED:
-                case PA_CONTEXT_TERMINATED:
-                    std::cerr << "Monitor context failed or terminated" << std::endl;
-                    break;
-                default:
-                    break;
+        pa_usec_t deadline = pa_rtclock_now() + static_cast<pa_usec_t>(config.metrics_interval_ms) * 1000;
+        if (metrics_timer) {
+            pa_context_rttime_restart(monitor_context, metrics_timer, deadline);
+        } else {
+            metrics_timer = pa_context_rttime_new(monitor_context, deadline, metricsTimerCallback, this);
+        }
+    }
+
+    bool AudioController::submit(ControlCommand command) {
+        if (command_fd < 0 || !running || !commands.push(std::move(command))) {
+            return false;
+        }
+        
+        uint64_t one = 1;
+        return write(command_fd, &one, sizeof(one)) == sizeof(one);
+    }
+
+    std::string AudioController::status() const {
+        std::ostringstream out;
+        out << "state=" << (held ? "held" : player.isPlaying() ? "playing" : "paused")
+            << " volume=" << player.getVolume()
+            << " level=" << status_level.load(std::memory_order_relaxed)
+            << " detection=" << config.detection_mode;
+        return out.str();
+    }
+
+    void AudioController::commandCallback([[maybe_unused]]pa_mainloop_api* api, [[maybe_unused]]pa_io_event* e, int fd,
+                                          [[maybe_unused]]pa_io_event_flags_t events, void* userdata) {
+        auto* controller = static_cast<AudioController*>(userdata);
+        
+        uint64_t pending = 0;
+        if (read(fd, &pending, sizeof(pending)) < 0 && errno != EAGAIN) {
+            std::cerr << "Failed to read command eventfd: " << strerror(errno) << std::endl;
+        }
+        
+        ControlCommand command;
+        while (controller->commands.pop(command)) {
+            controller->runCommand(command);
+        }
+    }
+
+    void AudioController::runCommand(ControlCommand& command) {
+        switch (command.type) {
+            case ControlCommand::Type::Pause:
+                held = true;
+                if (player.isPlaying()) {
+                    std::cout << "Pausing playback on request" << std::endl;
+                    pausePlayback();
+                }
+                break;
+            case ControlCommand::Type::Resume:
+                // Back to automatic control: the monitor resumes playback
+                // through play() right away unless other audio is playing.
+                if (held.exchange(false)) {
+                    std::cout << "Playback hold released" << std::endl;
+                    activity.onResumeTimer();
+                }
+                break;
+            case ControlCommand::Type::Volume:
+                std::cout << "Volume set to " << command.value << std::endl;
+                player.setVolume(command.value);
+                break;
+            case ControlCommand::Type::Next:
+                if (!player.nextTrack()) {
+                    std::cout << "Single track, nothing to skip to" << std::endl;
+                }
+                break;
+            case ControlCommand::Type::Reload:
+                if (command.config) {
+                    applySettings(*command.config);
+                }
+                break;
+        }
+    }
+
+    // Volume, layer levels, fades, detection thresholds and the metrics
+    // interval apply at once; tracks and backends are set up once at start.
+    void AudioController::applySettings(const Config& next) {
+        auto layerSources = [](const Config& c) {
+            std::vector<std::string> sources;
+            for (const LayerSettings& layer : c.layers) {
+                sources.push_back(layer.source);
             }
-        }, this);
+            return sources;
+        };
+        if (next.track_path != config.track_path || next.playlist != config.playlist ||
+            next.generator != config.generator || layerSources(next) != layerSources(config) ||
+            next.playlist_order != config.playlist_order || next.streaming != config.streaming ||
+            next.pcm_cache != config.pcm_cache || next.resample != config.resample ||
+            next.loop_crossfade_ms != config.loop_crossfade_ms || next.cache_dir != config.cache_dir ||
+            next.playback_backend != config.playback_backend || next.detection_mode != config.detection_mode ||
+            next.monitor_profile != config.monitor_profile || next.monitor_rate != config.monitor_rate ||
+            next.latency_profile != config.latency_profile) {
+            std::cout << "Track and backend changes take effect after a restart" << std::endl;
+        }
         
-        if (pa_context_connect(monitor_context, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0) {
-            std::cerr << "Failed to connect monitor context" << std::endl;
-            pa_context_unref(monitor_context);
-            pa_mainloop_free(monitor_mainloop);
+        config.volume = next.volume;
+        config.fade_in_ms = next.fade_in_ms;
+        config.fade_out_ms = next.fade_out_ms;
+        config.fade_shape = next.fade_shape;
+        if (layerSources(next) == layerSources(config)) {
+            config.layers = next.layers;
+        }
+        config.detector = next.detector;
+        config.metrics_interval_ms = next.metrics_interval_ms;
+        
+        player.applySettings(config);
+        activity.setSettings(config.detector);
+        exportMetrics();
+        std::cout << "Settings reloaded" << std::endl;
+    }
+
+    MonitorBackend::Clock::time_point AudioController::now() const {
+        return Clock::now();
+    }
+
+    void AudioController::armResumeTimer(std::chrono::microseconds delay) {
+        if (!monitor_context) {
             return;
         }
         
-        while (running) {
-            pa_mainloop_iterate(monitor_mainloop, 0, nullptr);
-            updateAudioActivity(current_system_volume);
-            std::this_thread::sleep_for(std::chrono::milliseconds(CHECK_INTERVAL_MS));
+        pa_usec_t deadline = pa_rtclock_now() + static_cast<pa_usec_t>(std::max<int64_t>(0, delay.count()));
+        if (resume_timer) {
+            pa_context_rttime_restart(monitor_context, resume_timer, deadline);
+        } else {
+            resume_timer = pa_context_rttime_new(monitor_context, deadline, resumeTimerCallback, this);
         }
     }
 
+    void AudioController::cancelResumeTimer() {
+        if (monitor_context && resume_timer) {
+            pa_context_rttime_restart(monitor_context, resume_timer, PA_USEC_INVALID);
+        }
+    }
+
+    bool AudioController::isPlaying() const {
+        return player.isPlaying();
+    }
+
+    void AudioController::play() {
+        if (held) {
+            return;
+        }
+        std::cout << "System audio inactive (" << activity.getLevel() << "), resuming playback" << std::endl;
+        AMBIENT_TRACE_INSTANT("resume", activity.getLevel());
+        resumes.add();
+        player.play();
+    }
+
+    void AudioController::pause() {
+        std::cout << "System audio active (" << activity.getLevel() << "), pausing playback" << std::endl;
+        AMBIENT_TRACE_INSTANT("pause", activity.getLevel());
+        reaction_seconds.observe(std::chrono::duration<double>(activity.getReactionTime()).count());
+        pausePlayback();
+    }
+
+    // Shared by the monitor and the pause command; only the monitor's
+    // pauses have a reaction time.
+    void AudioController::pausePlayback() {
+        pauses.add();
+        player.pause();
+    }
+
     bool AudioController::checkIfOurAppIsPlaying() {
         bool is_our_app = false;
     
@@ -343,17 +827,8 @@ namespace ambient{
                         return;
                     }
                     
-                    if (i && i->proplist) {
-                        const char* app_name = pa_proplist_gets(i->proplist, "application.name");
-                        const char* process_binary = pa_proplist_gets(i->proplist, "application.process.binary");
-                        
-                        if (app_name && strstr(app_name, "desktop_ambient") != nullptr) {
-                            *is_our_app_ptr = true;
-                        } else if (process_binary && (
-                            strstr(process_binary, "desktop_ambient") != nullptr ||
-                            strstr(process_binary, "audio_controller") != nullptr)) {
-                            *is_our_app_ptr = true;
-                        }
+                    if (i && isOwnStream(i)) {
+                        *is_our_app_ptr = true;
                     }
                 }, 
                 &is_our_app
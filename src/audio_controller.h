@@ -1,57 +1,144 @@
 #pragma once
 
 #include "audio_player.h"
+#include "config.h"
+#include "latency_profile.h"
+#include "loudness.h"
+#include "activity_monitor.h"
+#include "metrics.h"
+#include "control_server.h"
+#include "mpsc_queue.h"
 #include <atomic>
 #include <thread>
 #include <iostream>
 #include <unordered_map>
-#include <deque>
+#include <memory>
 
 namespace ambient{
 
-    class AudioController {
+    class AudioController : private MonitorBackend {
     public:
-        AudioController();
+        explicit AudioController(const Config& config);
         ~AudioController();
         
         bool init();
         void start();
         void stop();
+
+        // Queues a command for the reactor; callable from any thread. False
+        // if the reactor is not running or the queue is full.
+        bool submit(ControlCommand command);
+
+        // One line of key=value pairs for the control socket; callable from
+        // any thread.
+        std::string status() const;
+
+        // Readable once the reactor has lost the sound server and stopped;
+        // -1 before start().
+        int getFailureFd() const;
         
     private:
-        void monitorAudioActivity();
+        // Registry entry for one sink: its monitor stream and what analysing
+        // that stream needs. Entries live as long as the sink; a sink with
+        // nothing playing has its stream corked, so it costs nothing.
+        struct SinkMonitor {
+            AudioController* controller = nullptr;
+            uint32_t index = 0;
+            std::string name;
+            pa_stream* stream = nullptr;
+            bool is_ours = false;       // where our own track plays
+            bool corked = false;
+            bool peak = false;
+            SampleFormat format = SampleFormat::S16LE;
+            uint8_t channels = 2;
+            uint32_t rate = 44100;
+            LoudnessKernel loudness_kernel = selectLoudnessKernel(SampleFormat::S16LE);
+            ReferenceCanceller canceller;
+        };
+
         void monitorSystemOutput();
-        void updateAudioActivity(double system_volume);
-        bool setupMonitorStream();
+        void reportFailure();
+        void updateStreamActivity();
+        void openSinkMonitor(SinkMonitor& sink, const pa_sink_info* i);
+        void closeSinkMonitor(SinkMonitor& sink);
+        bool carriesOurTrack(const SinkMonitor& sink) const;
+        void updateOurSink();
+        bool wantsPeak(const SinkMonitor& sink) const;
+        void updateMonitorProfile();
+        void updateActiveSinks();
         bool checkIfOurAppIsPlaying();
+        static bool queryDefaultSinkSpec(pa_sample_spec& spec);
 
         static void contextStateCallback(pa_context* c, void* userdata);
         static void subscribeCallback(pa_context* c, pa_subscription_event_type_t t, uint32_t idx, void* userdata);
         static void sinkInputInfoCallback(pa_context* c, const pa_sink_input_info* i, int eol, void* userdata);
         static void sinkInfoCallback(pa_context* c, const pa_sink_info* i, int eol, void* userdata);
+        static void serverInfoCallback(pa_context* c, const pa_server_info* i, void* userdata);
         static void streamReadCallback(pa_stream* s, size_t length, void* userdata);
         static void streamStateCallback(pa_stream* s, void* userdata);
+        static void resumeTimerCallback(pa_mainloop_api* api, pa_time_event* e, const struct timeval* tv, void* userdata);
+        static void metricsTimerCallback(pa_mainloop_api* api, pa_time_event* e, const struct timeval* tv, void* userdata);
+        void exportMetrics();
+        static void commandCallback(pa_mainloop_api* api, pa_io_event* e, int fd, pa_io_event_flags_t events, void* userdata);
+        void runCommand(ControlCommand& command);
+        void applySettings(const Config& next);
+
+        Clock::time_point now() const override;
+        void armResumeTimer(std::chrono::microseconds delay) override;
+        void cancelResumeTimer() override;
+        bool isPlaying() const override;
+        void play() override;
+        void pause() override;
+        void pausePlayback();
         
+        Config config;
+        LatencyProfile latency{};
+
+        // Declared ahead of the player, which keeps handles into it.
+        MetricsRegistry metrics;
+        Counter& monitor_callbacks = metrics.addCounter("ambient_monitor_callbacks_total",
+                                                        "Monitor stream read callbacks.");
+        Counter& monitor_bytes = metrics.addCounter("ambient_monitor_bytes_total",
+                                                    "Monitor bytes analysed.");
+        Histogram& monitor_dsp_seconds = metrics.addHistogram("ambient_monitor_dsp_seconds",
+                                                              "Time spent analysing one monitor fragment.",
+                                                              Histogram::exponentialBuckets(5e-6, 2.0, 12));
+        Gauge& active_sinks = metrics.addGauge("ambient_monitor_active_sinks",
+                                               "Sinks whose monitor stream is running.");
+        Counter& pauses = metrics.addCounter("ambient_pauses_total", "Pauses for other audio.");
+        Counter& resumes = metrics.addCounter("ambient_resumes_total", "Resumes after other audio stopped.");
+        Histogram& reaction_seconds = metrics.addHistogram("ambient_reaction_seconds",
+                                                           "From the first loud fragment to the pause.",
+                                                           Histogram::exponentialBuckets(0.01, 2.0, 10));
+        std::string metrics_path;
+        pa_time_event* metrics_timer = nullptr;
+
         AudioPlayer player;
+        ActivityMonitor activity;
         std::atomic<bool> running{false};
         std::thread monitor_thread;
-        std::thread system_monitor_thread;
         
-        pa_stream* monitor_stream = nullptr;
         pa_context* monitor_context = nullptr;
         pa_mainloop* monitor_mainloop = nullptr;
+        pa_time_event* resume_timer = nullptr;
         
-        std::deque<double> volume_history;
-        std::atomic<double> current_system_volume{0.0};
-        
-        static constexpr double VOLUME_THRESHOLD = 0.016;
-        static constexpr double SILENCE_THRESHOLD = 0.001;
-        static constexpr int HISTORY_SIZE = 60;
-        static constexpr int CHECK_INTERVAL_MS = 50;
-        static constexpr int RESUME_DELAY_MS = 1000;
-
-        std::chrono::steady_clock::time_point last_activity_time;
-        bool system_was_active = false;
+        // Peak values per second the server sends in the peak profile.
+        static constexpr uint32_t PEAK_RATE = 100;
+        // Block peaks are compared against the RMS thresholds after
+        // dividing their power by this: a 9 dB crest factor, typical of
+        // speech and music.
+        static constexpr double PEAK_POWER_RATIO = 8.0;
+
+        std::unordered_map<uint32_t, std::unique_ptr<SinkMonitor>> sinks;
+        std::string default_sink;
+
+        // Control commands; the eventfd wakes the reactor to drain them.
+        MpscQueue<ControlCommand, 64> commands;
+        int command_fd = -1;
+        int failure_fd = -1;
+        std::atomic<bool> held{false};
+        std::atomic<double> status_level{0.0};
+        std::unordered_map<uint32_t, bool> sink_inputs;
     };
 
 } //ambient
\ No newline at end of file
@@ -1,8 +1,15 @@
 #include "audio_player.h"
-#include "audio.h"
-#include "ogg_decoder.h"
+#include "generator_source.h"
+#include "mixer_source.h"
+#include "playlist_source.h"
+#include "trace.h"
 
+#include <cstring>
 #include <iostream>
+#include <random>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace ambient{
 
@@ -10,81 +17,245 @@ namespace ambient{
         stop();
     }
 
-    bool validateOggData(const uint8_t* data, size_t size) {
-        if (size < 4) return false;
-        if (data[0] != 'O' || data[1] != 'g' || data[2] != 'g' || data[3] != 'S') {
-            std::cerr << "Invalid OGG signature" << std::endl;
-            return false;
+    bool toSampleFormat(pa_sample_format_t pa_format, SampleFormat& format) {
+        switch (pa_format) {
+            case PA_SAMPLE_S16LE: format = SampleFormat::S16LE; return true;
+            case PA_SAMPLE_S32LE: format = SampleFormat::S32LE; return true;
+            case PA_SAMPLE_FLOAT32LE: format = SampleFormat::Float32LE; return true;
+            default: return false;
         }
-        return true;
     }
 
-    bool AudioPlayer::init() {
+    bool AudioPlayer::init(const Config& config, const pa_sample_spec* output) {
         std::cout << "Player start init\n";
 
-        if (!validateOggData(audio_data.data(), audio_size)) {
-            std::cerr << "Invalid OGG data" << std::endl;
+        GeneratorType generator;
+        const bool generate = toGeneratorType(config.generator, generator);
+
+        std::vector<std::string> entries;
+        if (!generate && config.layers.empty()) {
+            entries = config.playlist;
+            if (entries.empty() && !config.track_path.empty()) {
+                entries.push_back(config.track_path);
+            }
+        }
+        std::vector<std::string> tracks = PlaylistSource::collectTracks(entries);
+        if (!entries.empty() && tracks.empty()) {
+            std::cerr << "Playlist contains no tracks" << std::endl;
             return false;
         }
 
-        OggDecoder decoder;
-        std::cout << "\tPlayer starting decoding audio\n";
-        if (!decoder.decode(audio_data.data(), audio_size)) {
-            std::cerr << "Failed to decode Ogg Vorbis data" << std::endl;
-            return false;
+        // Sink formats we cannot produce are left to the server; the rate
+        // is converted regardless.
+        auto makeLoader = [&](bool looping) {
+            TrackLoader loader(config, looping);
+            if (output) {
+                SampleFormat format = SampleFormat::S16LE;
+                toSampleFormat(output->format, format);
+                loader.setOutputFormat(output->rate, format);
+            }
+            return loader;
+        };
+
+        // The generator renders straight into the sink's rate and format.
+        PcmFormat format;
+        if (!config.layers.empty()) {
+            if (!openLayers(config, output, format)) {
+                return false;
+            }
+        } else if (generate) {
+            format.sample_rate = output ? output->rate : GeneratorSource::DEFAULT_RATE;
+            format.channels = GeneratorSource::MAX_CHANNELS;
+            if (output) {
+                toSampleFormat(output->format, format.sample_format);
+            }
+            source = std::make_unique<GeneratorSource>(generator, format.sample_rate, format.channels,
+                                                       format.sample_format, std::random_device{}());
+            std::cout << "\tPlayer generating " << config.generator << "\n";
+        } else if (tracks.size() > 1) {
+            auto playlist = std::make_unique<PlaylistSource>(std::move(tracks), config.playlist_order == "shuffle",
+                                                             makeLoader(false));
+            if (!playlist->start(format)) {
+                std::cerr << "No playable track in the playlist" << std::endl;
+                return false;
+            }
+            source = std::move(playlist);
+            std::cout << "\tPlayer playing a playlist\n";
+        } else {
+            std::string path = tracks.empty() ? std::string() : tracks.front();
+            TrackLoader loader = makeLoader(true);
+            LoadedTrack track;
+            if (!loader.load(path, false, track)) {
+                std::cerr << loader.getLastError() << std::endl;
+                return false;
+            }
+            format = track.format;
+            source = std::move(track.source);
+
+            if (track.needs_cache) {
+                fillCacheInBackground(std::move(loader), {path});
+            }
         }
-        std::cout << "\tPlayer finishing decoding audio\n";
-        
-        vSoundData = decoder.getPcmData();
-        sample_rate = decoder.getSampleRate();
-        channels = decoder.getChannels();
-        bits_per_sample = decoder.getBitsPerSample();
+
+        sample_rate = format.sample_rate;
+        channels = format.channels;
+        sample_format = format.sample_format;
+
+        use_stream_backend = config.playback_backend == "stream";
+        findLatencyProfile(config.latency_profile, latency);
         
-        if (vSoundData.empty()) {
-            std::cerr << "No sound data available after decoding" << std::endl;
-            return false;
-        }
+        applySettings(config);
+        gain.setFormat(sampleFormat(), channels);
+        reference.setFormat(sampleFormat(), channels, sample_rate);
+        gain.setGain(0.0f);
+        history.assign(static_cast<size_t>(latency.target_ms + HISTORY_MARGIN_MS) * sample_rate / 1000 * frameSize(), 0);
         
-        std::cout << "Decoded audio: " << audio_size << " bytes, "
-                  << sample_rate << " Hz, " << (int)channels << " channels, "
-                  << (int)bits_per_sample << " bits per sample" 
+        std::cout << "Audio: " << sample_rate << " Hz, " << (int)channels << " channels, "
+                  << sampleFormatName(sample_format)
+                  << "\nLatency profile " << latency.name << ": requesting "
+                  << describeBufferAttr(playbackBufferAttr(latency, sampleSpec()), sampleSpec(), true)
                   << "\nPlayer finish init"<< std::endl;
                   
         return true;
     }
 
+    // Decodes whole tracks at idle priority while the streaming sources
+    // play, so the next start can map the results instead of decoding.
+    void AudioPlayer::fillCacheInBackground(TrackLoader loader, std::vector<std::string> paths) {
+        cache_stop = false;
+        cache_thread = std::thread([this, loader = std::move(loader), paths = std::move(paths)]() {
+            setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+            AMBIENT_TRACE_THREAD("cache_fill");
+
+            for (const std::string& path : paths) {
+                if (cache_stop) {
+                    break;
+                }
+                if (loader.fillCache(path, cache_stop)) {
+                    std::cout << "PCM cache written" << std::endl;
+                }
+            }
+        });
+    }
+
+    // Every layer is loaded or generated in one rate and sample format, the
+    // sink's when known, and mixed into a single stream.
+    bool AudioPlayer::openLayers(const Config& config, const pa_sample_spec* output, PcmFormat& format) {
+        format.sample_rate = output ? output->rate : GeneratorSource::DEFAULT_RATE;
+        format.channels = MIXER_CHANNELS;
+        if (output) {
+            toSampleFormat(output->format, format.sample_format);
+        }
+
+        TrackLoader loader(config, true);
+        loader.setOutputFormat(format.sample_rate, format.sample_format);
+        std::vector<std::string> uncached;
+
+        auto mix = std::make_unique<MixerSource>(format.sample_rate, format.channels, format.sample_format);
+        for (const LayerSettings& layer : config.layers) {
+            GeneratorType type;
+            if (toGeneratorType(layer.source, type)) {
+                mix->addLayer(std::make_unique<GeneratorSource>(type, format.sample_rate, format.channels,
+                                                                format.sample_format, std::random_device{}()),
+                              format.channels, layer.volume);
+                continue;
+            }
+
+            LoadedTrack track;
+            if (!loader.load(layer.source, false, track)) {
+                std::cerr << loader.getLastError() << std::endl;
+                return false;
+            }
+            if (track.format.sample_rate != format.sample_rate || track.format.sample_format != format.sample_format ||
+                !mix->addLayer(std::move(track.source), track.format.channels, layer.volume)) {
+                std::cerr << layer.source << ": cannot be mixed as " << track.format.sample_rate << " Hz, "
+                          << (int)track.format.channels << " channels" << std::endl;
+                return false;
+            }
+            if (track.needs_cache) {
+                uncached.push_back(layer.source);
+            }
+        }
+
+        if (!uncached.empty()) {
+            fillCacheInBackground(std::move(loader), std::move(uncached));
+        }
+        mixer = mix.get();
+        source = std::move(mix);
+        std::cout << "\tPlayer mixing " << config.layers.size() << " layers\n";
+        return true;
+    }
+
     void AudioPlayer::play() {
         if (is_playing) return;
     
         std::cout << "Player start playing audio\n";
-        stop_requested = false;
-        is_playing = true;
-        gIsOurAudioPlaying = true;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            stop_requested = false;
+            is_playing = true;
+        }
+        state_cv.notify_all();
         
-        if (!playback_thread.joinable()) {
+        if (use_stream_backend) {
+            if (playback_stream && pa_stream_get_state(playback_stream) == PA_STREAM_READY) {
+                if (pa_stream_is_corked(playback_stream) == 1) {
+                    pa_operation* op = pa_stream_cork(playback_stream, 0, nullptr, nullptr);
+                    if (op) pa_operation_unref(op);
+                }
+                // The stream may have run dry after a fade-out; refill it.
+                streamWriteCallback(playback_stream, pa_stream_writable_size(playback_stream), this);
+            }
+        } else if (!playback_thread.joinable()) {
             playback_thread = std::thread(&AudioPlayer::playbackThread, this);
         }
     }
 
     void AudioPlayer::pause() {
+        if (!is_playing) return;
+        
         std::cout << "Player paused played audio\n";
-        is_playing = false;
-        gIsOurAudioPlaying = false;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            is_playing = false;
+        }
+        paused_at = std::chrono::steady_clock::now();
+        
+        // Drop what the server has queued so the fade-out starts now rather
+        // than after the buffer plays out. The flushed audio is rendered
+        // again, faded, once the server reports where playback stopped.
+        if (use_stream_backend && playback_stream && pa_stream_get_state(playback_stream) == PA_STREAM_READY &&
+            !flush_pending) {
+            pa_operation* op = pa_stream_flush(playback_stream, streamFlushCallback, this);
+            if (op) {
+                flush_pending = true;
+                pa_operation_unref(op);
+            }
+        }
     }
 
     void AudioPlayer::stop() {
         std::cout << "Player stopping\n";
-        stop_requested = true;
-        is_playing = false;
-        gIsOurAudioPlaying = false;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            stop_requested = true;
+            is_playing = false;
+        }
+        state_cv.notify_all();
         
         if (playback_thread.joinable()) {
             playback_thread.join();
         }
+
+        // A track still decoding for the cache is abandoned, not finished.
+        if (cache_thread.joinable()) {
+            cache_stop = true;
+            cache_thread.join();
+        }
         
-        if (pa_stream) {
-            pa_simple_free(reinterpret_cast<pa_simple*>(pa_stream));
-            pa_stream = nullptr;
+        if (simple_stream) {
+            pa_simple_free(simple_stream);
+            simple_stream = nullptr;
         }
     }
 
@@ -92,15 +263,314 @@ namespace ambient{
         return is_playing;
     }
 
-    void AudioPlayer::playbackThread() {
+    size_t AudioPlayer::frameSize() const {
+        return static_cast<size_t>(channels) * bytesPerSample(sample_format);
+    }
+
+    pa_sample_spec AudioPlayer::sampleSpec() const {
         pa_sample_spec ss;
         
-        ss.format = (bits_per_sample == 8) ? PA_SAMPLE_U8 : 
-                    (bits_per_sample == 16) ? PA_SAMPLE_S16LE :
-                    (bits_per_sample == 32) ? PA_SAMPLE_S32LE : PA_SAMPLE_S16LE;
+        ss.format = sample_format == SampleFormat::Float32LE ? PA_SAMPLE_FLOAT32LE :
+                    sample_format == SampleFormat::S32LE ? PA_SAMPLE_S32LE : PA_SAMPLE_S16LE;
         
         ss.rate = sample_rate;
         ss.channels = channels;
+        return ss;
+    }
+
+    SampleFormat AudioPlayer::sampleFormat() const {
+        return sample_format;
+    }
+
+    // Pulls PCM from the source and applies the gain stage. Pausing ramps
+    // the gain down over fade_out_ms and output continues until it is
+    // silent, then stops on that frame; resuming ramps back up over
+    // fade_in_ms from the next one.
+    size_t AudioPlayer::render(uint8_t* out, size_t bytes) {
+        AMBIENT_TRACE_SCOPE("render");
+        const bool playing = is_playing;
+        
+        float target = playing ? static_cast<float>(current_volume.load()) : 0.0f;
+        if (target != gain.getTarget()) {
+            int ramp_ms = !playing ? fade_out_ms.load() :
+                          gain.getTarget() == 0.0f ? fade_in_ms.load() : VOLUME_RAMP_MS;
+            gain.rampTo(target, static_cast<size_t>(ramp_ms) * sample_rate / 1000, fade_shape.load());
+        }
+        
+        size_t wanted = bytes / frameSize() * frameSize();
+        if (!playing) {
+            wanted = std::min(wanted, gain.getRemaining() * frameSize());
+        }
+        
+        size_t filled = replayHistory(out, wanted);
+        if (filled < wanted) {
+            size_t fresh = source->read(out + filled, wanted - filled);
+            keepHistory(out + filled, fresh);
+            filled += fresh;
+        }
+        
+        gain.process(out, filled / frameSize());
+        reference.push(out, filled / frameSize());
+        
+        return filled;
+    }
+
+    void AudioPlayer::keepHistory(const uint8_t* data, size_t bytes) {
+        if (history.empty()) {
+            return;
+        }
+        if (bytes > history.size()) {
+            data += bytes - history.size();
+            history_end += bytes - history.size();
+            bytes = history.size();
+        }
+        
+        size_t pos = static_cast<size_t>(history_end % history.size());
+        size_t first = std::min(bytes, history.size() - pos);
+        memcpy(history.data() + pos, data, first);
+        memcpy(history.data(), data + first, bytes - first);
+        history_end += bytes;
+    }
+
+    size_t AudioPlayer::replayHistory(uint8_t* out, size_t bytes) {
+        size_t n = std::min(bytes, replay_bytes);
+        if (n == 0) {
+            return 0;
+        }
+        
+        size_t pos = static_cast<size_t>((history_end - replay_bytes) % history.size());
+        size_t first = std::min(n, history.size() - pos);
+        memcpy(out, history.data() + pos, first);
+        memcpy(out + first, history.data(), n - first);
+        replay_bytes -= n;
+        return n;
+    }
+
+    // Puts the last `bytes` taken from the source back in front of it, as
+    // far back as the history reaches. The stream lost all of them, so the
+    // reference drops them too and takes what is rendered in their place.
+    void AudioPlayer::rewind(size_t bytes) {
+        const size_t frame = frameSize();
+        reference.rewind(bytes / frame);
+        size_t kept = static_cast<size_t>(std::min<uint64_t>(history.size(), history_end));
+        replay_bytes = std::min(replay_bytes + bytes / frame * frame, kept / frame * frame);
+    }
+
+    // The effective pause latency: how long after the decision our audio
+    // had faded out and left the stream, flush and fade included.
+    void AudioPlayer::observePause() {
+        auto start = paused_at.exchange({});
+        if (pause_seconds && start != std::chrono::steady_clock::time_point{}) {
+            pause_seconds->observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+    bool AudioPlayer::isAudible() const {
+        return is_playing || !gain.isSilent();
+    }
+
+    bool AudioPlayer::attachStream(pa_context* context) {
+        if (!use_stream_backend || playback_stream) {
+            return true;
+        }
+        
+        pa_sample_spec ss = sampleSpec();
+        playback_stream = pa_stream_new(context, "BackgroundSound", &ss, nullptr);
+        if (!playback_stream) {
+            std::cerr << "Failed to create playback stream: " << pa_strerror(pa_context_errno(context)) << std::endl;
+            return false;
+        }
+        
+        pa_stream_set_state_callback(playback_stream, streamStateCallback, this);
+        pa_stream_set_write_callback(playback_stream, streamWriteCallback, this);
+        pa_stream_set_underflow_callback(playback_stream, streamUnderflowCallback, this);
+        pa_stream_set_moved_callback(playback_stream, streamMovedCallback, this);
+        
+        // Timing updates keep the reference alignment current. With
+        // ADJUST_LATENCY the profile's tlength is the whole latency, sink
+        // included, rather than the stream's share of it.
+        pa_buffer_attr attr = playbackBufferAttr(latency, ss);
+        auto flags = static_cast<pa_stream_flags_t>(PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE |
+                                                    PA_STREAM_ADJUST_LATENCY |
+                                                    (is_playing ? PA_STREAM_NOFLAGS : PA_STREAM_START_CORKED));
+        if (pa_stream_connect_playback(playback_stream, nullptr, &attr, flags, nullptr, nullptr) < 0) {
+            std::cerr << "Failed to connect playback stream: " << pa_strerror(pa_context_errno(context)) << std::endl;
+            pa_stream_unref(playback_stream);
+            playback_stream = nullptr;
+            return false;
+        }
+        
+        return true;
+    }
+
+    void AudioPlayer::detachStream() {
+        if (playback_stream) {
+            pa_stream_set_write_callback(playback_stream, nullptr, nullptr);
+            pa_stream_set_underflow_callback(playback_stream, nullptr, nullptr);
+            pa_stream_set_moved_callback(playback_stream, nullptr, nullptr);
+            pa_stream_set_state_callback(playback_stream, nullptr, nullptr);
+            pa_stream_disconnect(playback_stream);
+            pa_stream_unref(playback_stream);
+            playback_stream = nullptr;
+        }
+        stream_written = 0;
+        flush_pending = false;
+        drain_pending = false;
+    }
+
+    // Fills the server's buffer in place, in exactly the amounts it asks for.
+    void AudioPlayer::streamWriteCallback(pa_stream* s, size_t length, void* userdata) {
+        auto* player = static_cast<AudioPlayer*>(userdata);
+        AMBIENT_TRACE_SCOPE("stream_write");
+        
+        if (player->flush_pending) {
+            return;
+        }
+        
+        while (length > 0 && player->isAudible()) {
+            void* data = nullptr;
+            size_t bytes = length;
+            
+            if (pa_stream_begin_write(s, &data, &bytes) < 0 || !data) {
+                std::cerr << "Failed to begin write: " << pa_strerror(pa_context_errno(pa_stream_get_context(s))) << std::endl;
+                return;
+            }
+            
+            size_t filled = player->render(static_cast<uint8_t*>(data), std::min(bytes, length));
+            if (filled == 0) {
+                pa_stream_cancel_write(s);
+                break;
+            }
+            
+            if (pa_stream_write(s, data, filled, nullptr, 0, PA_SEEK_RELATIVE) < 0) {
+                std::cerr << "Failed to write to PulseAudio: " << pa_strerror(pa_context_errno(pa_stream_get_context(s))) << std::endl;
+                return;
+            }
+            player->stream_written += filled;
+            length -= std::min(length, filled);
+        }
+        
+        // Faded out: once the tail has played, cork the stream so neither
+        // we nor the server's mixer touch it until resume.
+        if (!player->isAudible() && !player->drain_pending && pa_stream_is_corked(s) == 0) {
+            pa_operation* op = pa_stream_drain(s, streamDrainCallback, userdata);
+            if (op) {
+                player->drain_pending = true;
+                pa_operation_unref(op);
+            }
+        }
+        
+        // What separates our writes from the mixer is the stream's own
+        // buffer: the sink part of the latency applies to the monitor too.
+        pa_usec_t latency = 0;
+        int negative = 0;
+        const pa_timing_info* timing = pa_stream_get_timing_info(s);
+        if (timing && pa_stream_get_latency(s, &latency, &negative) == 0 && !negative) {
+            player->reference.setQueuedLatency(latency > timing->sink_usec ? latency - timing->sink_usec : 0);
+            if (player->latency_seconds) {
+                player->latency_seconds->observe(latency / 1e6);
+            }
+        }
+    }
+
+    // The stream also runs dry after every fade-out; only a starved stream
+    // that should be playing counts as an underrun.
+    void AudioPlayer::streamUnderflowCallback([[maybe_unused]]pa_stream* s, void* userdata) {
+        auto* player = static_cast<AudioPlayer*>(userdata);
+        if (player->is_playing && player->underruns) {
+            player->underruns->add();
+            AMBIENT_TRACE_INSTANT("underrun", 1.0);
+        }
+    }
+
+    // Stream-restore or the user moved us to another sink.
+    void AudioPlayer::streamMovedCallback(pa_stream* s, void* userdata) {
+        auto* player = static_cast<AudioPlayer*>(userdata);
+        std::cout << "Playback stream moved to sink " << pa_stream_get_device_index(s) << std::endl;
+        if (player->sink_changed) {
+            player->sink_changed();
+        }
+    }
+
+    uint32_t AudioPlayer::getSinkIndex() const {
+        if (!playback_stream || pa_stream_get_state(playback_stream) != PA_STREAM_READY) {
+            return PA_INVALID_INDEX;
+        }
+        return pa_stream_get_device_index(playback_stream);
+    }
+
+    void AudioPlayer::setSinkChangedHandler(std::function<void()> handler) {
+        sink_changed = std::move(handler);
+    }
+
+    void AudioPlayer::streamFlushCallback(pa_stream* s, int success, void* userdata) {
+        auto* player = static_cast<AudioPlayer*>(userdata);
+        
+        pa_operation* op = success ? pa_stream_update_timing_info(s, streamFlushedCallback, userdata) : nullptr;
+        if (op) {
+            pa_operation_unref(op);
+            return;
+        }
+        
+        player->flush_pending = false;
+        streamWriteCallback(s, pa_stream_writable_size(s), userdata);
+    }
+
+    // The flush moved the write index back to the read index: everything
+    // written past it never played, and is rendered again from the history.
+    void AudioPlayer::streamFlushedCallback(pa_stream* s, int success, void* userdata) {
+        auto* player = static_cast<AudioPlayer*>(userdata);
+        player->flush_pending = false;
+        
+        const pa_timing_info* timing = pa_stream_get_timing_info(s);
+        if (success && timing && !timing->write_index_corrupt && timing->write_index >= 0 &&
+            static_cast<uint64_t>(timing->write_index) < player->stream_written) {
+            player->rewind(static_cast<size_t>(player->stream_written - timing->write_index));
+            player->stream_written = static_cast<uint64_t>(timing->write_index);
+        }
+        
+        streamWriteCallback(s, pa_stream_writable_size(s), userdata);
+    }
+
+    void AudioPlayer::streamDrainCallback(pa_stream* s, [[maybe_unused]]int success, void* userdata) {
+        auto* player = static_cast<AudioPlayer*>(userdata);
+        player->drain_pending = false;
+        
+        if (!player->isAudible()) {
+            player->observePause();
+            pa_operation* op = pa_stream_cork(s, 1, nullptr, nullptr);
+            if (op) pa_operation_unref(op);
+        }
+    }
+
+    void AudioPlayer::streamStateCallback(pa_stream* s, void* userdata) {
+        auto* player = static_cast<AudioPlayer*>(userdata);
+        
+        switch (pa_stream_get_state(s)) {
+            case PA_STREAM_READY:
+                if (const pa_buffer_attr* attr = pa_stream_get_buffer_attr(s)) {
+                    std::cout << "Playback stream ready: " << describeBufferAttr(*attr, *pa_stream_get_sample_spec(s), true)
+                              << std::endl;
+                } else {
+                    std::cout << "Playback stream ready" << std::endl;
+                }
+                if (player->sink_changed) {
+                    player->sink_changed();
+                }
+                break;
+            case PA_STREAM_FAILED:
+                std::cerr << "Playback stream failed: " << pa_strerror(pa_context_errno(pa_stream_get_context(s))) << std::endl;
+                break;
+            default:
+                break;
+        }
+    }
+
+    // pa_simple asks for ADJUST_LATENCY itself but cannot report what the
+    // server granted; only the request is logged, at init.
+    pa_simple* AudioPlayer::openSimple() {
+        pa_sample_spec ss = sampleSpec();
+        pa_buffer_attr attr = playbackBufferAttr(latency, ss);
         
         int error;
         pa_simple* s = pa_simple_new(
@@ -111,50 +581,119 @@ namespace ambient{
             "BackgroundSound",
             &ss,
             nullptr,
-            nullptr,
+            &attr,
             &error
         );
         
         if (!s) {
             std::cerr << "Failed to create PulseAudio stream: " << pa_strerror(error) << std::endl;
-            is_playing = false;
-            return;
         }
-        
-        pa_stream = s;
-        size_t offset = 0;
+        return s;
+    }
+
+    void AudioPlayer::playbackThread() {
+        AMBIENT_TRACE_THREAD("playback");
+        const pa_sample_spec ss = sampleSpec();
+        pa_simple* s = nullptr;
+        int error;
+        bool was_playing = false;
+
+        std::vector<uint8_t> buffer(CHUNK_SIZE / frameSize() * frameSize());
         
         while (!stop_requested) {
-           if (!is_playing) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            // Faded out: let the tail play, then close the stream so the
+            // server stops mixing it. The thread sleeps until resume and
+            // carries on from the same source position.
+            if (!isAudible()) {
+                if (s) {
+                    if (pa_simple_drain(s, &error) < 0) {
+                        std::cerr << "Failed to drain PulseAudio: " << pa_strerror(error) << std::endl;
+                    } else {
+                        observePause();
+                    }
+                    pa_simple_free(s);
+                    s = nullptr;
+                    simple_stream = nullptr;
+                }
+                was_playing = false;
+                std::unique_lock<std::mutex> lock(state_mutex);
+                state_cv.wait(lock, [this] { return is_playing || stop_requested; });
                 continue;
             }
             
-            size_t remaining = vSoundData.size() - offset;
-            size_t to_write = std::min(remaining, static_cast<size_t>(4096));
-            
-            if (to_write > 0) {
-                if (pa_simple_write(s, vSoundData.data() + offset, to_write, &error) < 0) {
-                    std::cerr << "Failed to write to PulseAudio: " << pa_strerror(error) << std::endl;
+            if (!s) {
+                s = openSimple();
+                if (!s) {
                     break;
                 }
-                offset += to_write;
+                simple_stream = s;
+            }
+            
+            // Just paused: drop what the server has queued so the fade-out
+            // starts now, and render it again faded. The latency includes
+            // the sink's share, so a few ms may be heard twice.
+            bool playing = is_playing;
+            if (was_playing && !playing) {
+                pa_usec_t queued = pa_simple_get_latency(s, &error);
+                if (queued != static_cast<pa_usec_t>(-1) && pa_simple_flush(s, &error) >= 0) {
+                    rewind(pa_usec_to_bytes(queued, &ss));
+                }
+            }
+            was_playing = playing;
+            
+            size_t to_write = render(buffer.data(), buffer.size());
+            if (to_write == 0) {
+                if (!isAudible()) {
+                    continue;
+                }
+                std::cerr << "Audio source ran dry" << std::endl;
+                break;
+            }
+            
+            bool written;
+            {
+                AMBIENT_TRACE_SCOPE("pa_simple_write");
+                written = pa_simple_write(s, buffer.data(), to_write, &error) >= 0;
+            }
+            if (!written) {
+                std::cerr << "Failed to write to PulseAudio: " << pa_strerror(error) << std::endl;
+                break;
             }
             
-            if (offset >= vSoundData.size()) {
-                offset = 0;
+            pa_usec_t latency = pa_simple_get_latency(s, &error);
+            if (latency != static_cast<pa_usec_t>(-1)) {
+                reference.setQueuedLatency(latency);
+                if (latency_seconds) {
+                    latency_seconds->observe(latency / 1e6);
+                }
             }
         }
         
-        if (pa_simple_drain(s, &error) < 0) {
-            std::cerr << "Failed to drain PulseAudio: " << pa_strerror(error) << std::endl;
+        if (s) {
+            if (pa_simple_drain(s, &error) < 0) {
+                std::cerr << "Failed to drain PulseAudio: " << pa_strerror(error) << std::endl;
+            }
+            pa_simple_free(s);
+            simple_stream = nullptr;
         }
-        
-        pa_simple_free(s);
-        pa_stream = nullptr;
         is_playing = false;
     }
 
+    const OutputReference& AudioPlayer::getReference() const {
+        return reference;
+    }
+
+    void AudioPlayer::registerMetrics(MetricsRegistry& registry) {
+        latency_seconds = &registry.addHistogram("ambient_playback_latency_seconds",
+                                                 "Playback stream latency reported after each write.",
+                                                 Histogram::exponentialBuckets(0.005, 2.0, 10));
+        underruns = &registry.addCounter("ambient_playback_underruns_total",
+                                         "Playback stream underflows while playing.");
+        pause_seconds = &registry.addHistogram("ambient_pause_silence_seconds",
+                                               "From the pause to the end of the fade-out leaving the stream.",
+                                               Histogram::exponentialBuckets(0.025, 2.0, 10));
+    }
+
     void AudioPlayer::setVolume(double volume) {
         current_volume = std::max(0.0, std::min(1.0, volume));
     }
@@ -163,4 +702,20 @@ namespace ambient{
         return current_volume;
     }
 
+    void AudioPlayer::applySettings(const Config& config) {
+        setVolume(config.volume);
+        if (mixer && mixer->getLayerCount() == config.layers.size()) {
+            for (size_t i = 0; i < config.layers.size(); ++i) {
+                mixer->setLayerVolume(i, config.layers[i].volume);
+            }
+        }
+        fade_in_ms = config.fade_in_ms;
+        fade_out_ms = config.fade_out_ms;
+        fade_shape = config.fade_shape == "exponential" ? RampShape::Exponential : RampShape::Linear;
+    }
+
+    bool AudioPlayer::nextTrack() {
+        return source && source->skip();
+    }
+
 } //ambient
\ No newline at end of file
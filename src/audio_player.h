@@ -1,21 +1,39 @@
 #pragma once
 
+#include "audio_source.h"
+#include "config.h"
+#include "track_loader.h"
+#include "gain.h"
+#include "metrics.h"
+#include "output_reference.h"
+#include "latency_profile.h"
+#include "mixer_source.h"
+
 #include <vector>
 #include <atomic>
+#include <chrono>
 #include <thread>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <pulse/pulseaudio.h>
 #include <pulse/simple.h>
 #include <pulse/error.h>
 
 namespace ambient{
-    static std::atomic<bool> gIsOurAudioPlaying{false};
+
+    // PulseAudio sample formats the DSP code handles natively.
+    bool toSampleFormat(pa_sample_format_t pa_format, SampleFormat& format);
 
     class AudioPlayer {
     public:
         AudioPlayer() = default;
         ~AudioPlayer();
 
-        bool init();
+        // With `output`, tracks are converted to that sample spec at load
+        // time; it should be the sink's, so the server does not convert.
+        bool init(const Config& config, const pa_sample_spec* output = nullptr);
         void play();
         void pause();
         void stop();
@@ -24,20 +42,102 @@ namespace ambient{
         void setVolume(double volume);
         double getVolume() const;
 
+        // Volume and fades from `config`; takes effect from the next chunk.
+        void applySettings(const Config& config);
+        // Skips to the next playlist track; false with a single track.
+        bool nextTrack();
+
+        // Asynchronous backend: the stream lives on the controller's
+        // mainloop and both calls must come from that thread.
+        bool attachStream(pa_context* context);
+        void detachStream();
+        // The sink the stream plays on, PA_INVALID_INDEX until it is
+        // connected or with the simple backend. The handler runs on the
+        // mainloop when the stream connects and whenever it is moved.
+        uint32_t getSinkIndex() const;
+        void setSinkChangedHandler(std::function<void()> handler);
+
+        // Everything written so far, for telling our output apart from
+        // other applications' on the monitor.
+        const OutputReference& getReference() const;
+
+        // Publishes playback latency and underruns; the registry must
+        // outlive the player.
+        void registerMetrics(MetricsRegistry& registry);
+
     private:
         void playbackThread();
+        size_t render(uint8_t* out, size_t bytes);
+        void keepHistory(const uint8_t* data, size_t bytes);
+        size_t replayHistory(uint8_t* out, size_t bytes);
+        void rewind(size_t bytes);
+        pa_simple* openSimple();
+        void observePause();
+        bool isAudible() const;
+        size_t frameSize() const;
+        SampleFormat sampleFormat() const;
+        pa_sample_spec sampleSpec() const;
+        bool openLayers(const Config& config, const pa_sample_spec* output, PcmFormat& format);
+        void fillCacheInBackground(TrackLoader loader, std::vector<std::string> paths);
 
-        std::vector<uint8_t> vSoundData;
+        static void streamWriteCallback(pa_stream* s, size_t length, void* userdata);
+        static void streamStateCallback(pa_stream* s, void* userdata);
+        static void streamUnderflowCallback(pa_stream* s, void* userdata);
+        static void streamMovedCallback(pa_stream* s, void* userdata);
+        static void streamFlushCallback(pa_stream* s, int success, void* userdata);
+        static void streamFlushedCallback(pa_stream* s, int success, void* userdata);
+        static void streamDrainCallback(pa_stream* s, int success, void* userdata);
+
+        std::unique_ptr<AudioSource> source;
+        MixerSource* mixer = nullptr;   // the source, when layers are mixed
         uint32_t sample_rate = 44100;
         uint8_t channels = 2;
-        uint8_t bits_per_sample = 16;
+        SampleFormat sample_format = SampleFormat::S16LE;
         
         std::atomic<bool> is_playing{false};
         std::atomic<bool> stop_requested{false};
         std::thread playback_thread;
+        std::thread cache_thread;
+        std::atomic<bool> cache_stop{false};
+        std::mutex state_mutex;
+        std::condition_variable state_cv;
         
-        void* pa_stream = nullptr;
-        double current_volume = 0.5;
+        bool use_stream_backend = true;
+        LatencyProfile latency{};
+        pa_simple* simple_stream = nullptr;
+        pa_stream* playback_stream = nullptr;
+        std::function<void()> sink_changed;
+        std::atomic<double> current_volume{0.5};
+        std::atomic<std::chrono::steady_clock::time_point> paused_at{};
+
+        // Pre-gain PCM most recently taken from the source, so audio flushed
+        // from the server on pause can be rendered again, faded, from the
+        // position it was flushed at. Used by whichever thread renders.
+        std::vector<uint8_t> history;
+        uint64_t history_end = 0;       // source bytes taken so far
+        size_t replay_bytes = 0;        // history still to render again
+
+        // Stream backend, reactor thread only.
+        uint64_t stream_written = 0;
+        bool flush_pending = false;
+        bool drain_pending = false;
+
+        GainRamp gain;
+        OutputReference reference;
+        std::atomic<int> fade_in_ms{1000};
+        std::atomic<int> fade_out_ms{300};
+        std::atomic<RampShape> fade_shape{RampShape::Linear};
+
+        Histogram* latency_seconds = nullptr;
+        Counter* underruns = nullptr;
+        Histogram* pause_seconds = nullptr;
+
+        static constexpr size_t CHUNK_SIZE = 4096;
+        static constexpr unsigned MIXER_CHANNELS = 2;
+        static constexpr int VOLUME_RAMP_MS = 50;
+        // History kept beyond the profile's target buffer, for servers
+        // that grant more than was asked.
+        static constexpr int HISTORY_MARGIN_MS = 500;
     };
     
 } //ambient
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "audio_source.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace ambient {
+
+    BufferSource::BufferSource(std::vector<uint8_t> pcm, size_t loop_start)
+        : pcm_data(std::move(pcm)), pcm(pcm_data.data()), pcm_size(pcm_data.size()),
+          loop_start(loop_start < pcm_size ? loop_start : 0) {}
+
+    BufferSource::BufferSource(MappedFile file, const uint8_t* pcm, size_t size, size_t loop_start)
+        : mapping(std::move(file)), pcm(pcm), pcm_size(size), loop_start(loop_start < size ? loop_start : 0) {}
+
+    size_t BufferSource::read(uint8_t* out, size_t bytes) {
+        if (pcm_size == 0) {
+            return 0;
+        }
+
+        size_t filled = 0;
+        while (filled < bytes) {
+            size_t chunk = std::min(bytes - filled, pcm_size - offset);
+            memcpy(out + filled, pcm + offset, chunk);
+            filled += chunk;
+            offset += chunk;
+
+            if (offset >= pcm_size) {
+                if (!looping) {
+                    break;
+                }
+                offset = loop_start;
+            }
+        }
+
+        return filled;
+    }
+
+    void BufferSource::setLooping(bool looping) {
+        this->looping = looping;
+    }
+
+    bool StreamingSource::open(const uint8_t* data, size_t size, int loop_crossfade_ms) {
+        decoder.setLoopCrossfade(loop_crossfade_ms);
+        return decoder.openStream(data, size);
+    }
+
+    bool StreamingSource::open(MappedFile file, int loop_crossfade_ms) {
+        this->file = std::move(file);
+        return open(this->file.getData(), this->file.getSize(), loop_crossfade_ms);
+    }
+
+    size_t StreamingSource::read(uint8_t* out, size_t bytes) {
+        size_t filled = decoder.readStream(out, bytes);
+        if (filled < bytes && !decoder.getLastError().empty()) {
+            std::cerr << "Streaming decode failed: " << decoder.getLastError() << std::endl;
+        }
+        return filled;
+    }
+
+    void StreamingSource::setLooping(bool looping) {
+        decoder.setLooping(looping);
+    }
+
+    const OggDecoder& StreamingSource::getDecoder() const {
+        return decoder;
+    }
+
+    ConvertingSource::ConvertingSource(std::unique_ptr<AudioSource> inner, uint32_t input_rate, unsigned channels,
+                                       uint32_t rate, SampleFormat format)
+        : inner(std::move(inner)), channels(channels), format(format), resample(input_rate != rate),
+          input(INPUT_FRAMES * channels), samples(INPUT_FRAMES * channels) {
+        if (resample) {
+            resampler.setup(input_rate, rate, channels);
+        }
+    }
+
+    // Pulls one block from the inner source into `pending`. At the end of a
+    // non-looping track the filter is flushed with silence once.
+    bool ConvertingSource::refill() {
+        if (pending_pos == pending.size()) {
+            pending.clear();
+            pending_pos = 0;
+        }
+
+        size_t frames = inner->read(reinterpret_cast<uint8_t*>(input.data()), input.size() * sizeof(int16_t)) /
+                        (channels * sizeof(int16_t));
+        if (frames == 0) {
+            if (drained || !resample) {
+                return false;
+            }
+            drained = true;
+            size_t tail = resampler.getDelay() + 1;
+            samples.assign(std::max(samples.size(), tail * channels), 0.0f);
+            resampler.process(samples.data(), tail, pending);
+            return true;
+        }
+
+        s16ToFloat(input.data(), samples.data(), frames * channels);
+        if (resample) {
+            resampler.process(samples.data(), frames, pending);
+        } else {
+            pending.insert(pending.end(), samples.begin(), samples.begin() + frames * channels);
+        }
+        return true;
+    }
+
+    size_t ConvertingSource::read(uint8_t* out, size_t bytes) {
+        const size_t frame_bytes = bytesPerSample(format) * channels;
+        const size_t frames = bytes / frame_bytes;
+        size_t filled = 0;
+
+        while (filled < frames) {
+            size_t available = (pending.size() - pending_pos) / channels;
+            if (available == 0) {
+                if (!refill()) {
+                    break;
+                }
+                continue;
+            }
+
+            size_t n = std::min(available, frames - filled);
+            floatToPcm(pending.data() + pending_pos, n * channels, format, out + filled * frame_bytes);
+            pending_pos += n * channels;
+            filled += n;
+        }
+
+        return filled * frame_bytes;
+    }
+
+    void ConvertingSource::setLooping(bool looping) {
+        inner->setLooping(looping);
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "ogg_decoder.h"
+#include "mapped_file.h"
+#include "resampler.h"
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace ambient {
+
+    // Producer of interleaved PCM for the playback thread. Sources loop
+    // forever by default, so read() only returns short on error; with
+    // looping off it also returns short at the end of the track.
+    class AudioSource {
+    public:
+        virtual ~AudioSource() = default;
+
+        virtual size_t read(uint8_t* out, size_t bytes) = 0;
+        virtual void setLooping(bool looping) = 0;
+
+        // Asks the source to move on to its next track at the next read;
+        // safe from any thread. False if it only has the one.
+        virtual bool skip() { return false; }
+    };
+
+    // Plays a fully decoded track, either owned in memory or from a mapped
+    // PCM cache file. At the end it wraps to `loop_start` (in bytes); any
+    // crossfade is already part of the buffer.
+    class BufferSource : public AudioSource {
+    public:
+        explicit BufferSource(std::vector<uint8_t> pcm, size_t loop_start = 0);
+        BufferSource(MappedFile file, const uint8_t* pcm, size_t size, size_t loop_start = 0);
+
+        size_t read(uint8_t* out, size_t bytes) override;
+        void setLooping(bool looping) override;
+
+    private:
+        std::vector<uint8_t> pcm_data;
+        MappedFile mapping;
+        const uint8_t* pcm = nullptr;
+        size_t pcm_size = 0;
+        size_t loop_start = 0;
+        size_t offset = 0;
+        bool looping = true;
+    };
+
+    // Decodes the Ogg stream on demand, so resident PCM is bounded by the
+    // caller's buffer regardless of track length.
+    class StreamingSource : public AudioSource {
+    public:
+        bool open(const uint8_t* data, size_t size, int loop_crossfade_ms);
+        // Streams from a mapped file, which the source then keeps alive.
+        bool open(MappedFile file, int loop_crossfade_ms);
+
+        size_t read(uint8_t* out, size_t bytes) override;
+        void setLooping(bool looping) override;
+
+        const OggDecoder& getDecoder() const;
+
+    private:
+        MappedFile file;
+        OggDecoder decoder;
+    };
+
+    // Converts an S16 source to another rate and sample format as it plays,
+    // for streamed tracks that are not in the output format.
+    class ConvertingSource : public AudioSource {
+    public:
+        ConvertingSource(std::unique_ptr<AudioSource> inner, uint32_t input_rate, unsigned channels,
+                         uint32_t rate, SampleFormat format);
+
+        size_t read(uint8_t* out, size_t bytes) override;
+        void setLooping(bool looping) override;
+
+    private:
+        bool refill();
+
+        std::unique_ptr<AudioSource> inner;
+        Resampler resampler;
+        unsigned channels;
+        SampleFormat format;
+        bool resample;
+        bool drained = false;
+        std::vector<int16_t> input;
+        std::vector<float> samples;
+        std::vector<float> pending;
+        size_t pending_pos = 0;
+
+        static constexpr size_t INPUT_FRAMES = 1024;
+    };
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "config.h"
+#include "generator_source.h"
+#include "latency_profile.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace ambient {
+
+    static std::string trim(const std::string& s) {
+        size_t begin = s.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            return "";
+        }
+        size_t end = s.find_last_not_of(" \t\r");
+        return s.substr(begin, end - begin + 1);
+    }
+
+    static bool parseBool(const std::string& value, bool& out) {
+        if (value == "1" || value == "true" || value == "yes" || value == "on") {
+            out = true;
+            return true;
+        }
+        if (value == "0" || value == "false" || value == "no" || value == "off") {
+            out = false;
+            return true;
+        }
+        return false;
+    }
+
+    static bool parseDouble(const std::string& value, double& out) {
+        try {
+            size_t used = 0;
+            double parsed = std::stod(value, &used);
+            if (used != value.size() || !std::isfinite(parsed) || parsed < 0.0) {
+                return false;
+            }
+            out = parsed;
+            return true;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    static bool parseInt(const std::string& value, int& out) {
+        double parsed;
+        // Out-of-range values would make the cast undefined.
+        if (!parseDouble(value, parsed) || parsed > std::numeric_limits<int>::max() ||
+            parsed != static_cast<int>(parsed)) {
+            return false;
+        }
+        out = static_cast<int>(parsed);
+        return true;
+    }
+
+    std::string Config::defaultPath() {
+        if (const char* env = std::getenv("AMBIENT_CONFIG")) {
+            return env;
+        }
+
+        std::string base;
+        if (const char* xdg = std::getenv("XDG_CONFIG_HOME"); xdg && *xdg) {
+            base = xdg;
+        } else if (const char* home = std::getenv("HOME")) {
+            base = std::string(home) + "/.config";
+        } else {
+            return "";
+        }
+        return base + "/desktop_ambient/desktop_ambient.conf";
+    }
+
+    Config Config::load(const std::string& path) {
+        Config config;
+        if (path.empty()) {
+            return config;
+        }
+
+        std::ifstream file(path);
+        if (!file) {
+            return config;
+        }
+
+        std::cout << "Loading config from " << path << std::endl;
+
+        std::string line;
+        int line_number = 0;
+        while (std::getline(file, line)) {
+            ++line_number;
+            line = trim(line);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                std::cerr << path << ":" << line_number << ": expected key = value" << std::endl;
+                continue;
+            }
+
+            std::string key = trim(line.substr(0, eq));
+            std::string value = trim(line.substr(eq + 1));
+            if (!config.set(key, value)) {
+                std::cerr << path << ":" << line_number << ": invalid setting '" << key << "'" << std::endl;
+            }
+        }
+
+        return config;
+    }
+
+    bool Config::set(const std::string& key, const std::string& value) {
+        if (key == "track") {
+            track_path = value;
+            return true;
+        }
+        if (key == "playlist") {
+            playlist.push_back(value);
+            return true;
+        }
+        // "layer = <track or generator> [volume]"; a trailing number is the
+        // volume, so paths may contain spaces.
+        if (key == "layer") {
+            LayerSettings layer;
+            layer.source = value;
+            size_t space = value.find_last_of(" \t");
+            if (space != std::string::npos && parseDouble(value.substr(space + 1), layer.volume)) {
+                if (layer.volume > 1.0) {
+                    return false;
+                }
+                layer.source = trim(value.substr(0, space));
+            }
+            if (layer.source.empty()) {
+                return false;
+            }
+            layers.push_back(layer);
+            return true;
+        }
+        if (key == "playlist_order") {
+            if (value != "sequential" && value != "shuffle") {
+                return false;
+            }
+            playlist_order = value;
+            return true;
+        }
+        if (key == "streaming") {
+            return parseBool(value, streaming);
+        }
+        if (key == "decode_threads") {
+            int parsed;
+            if (!parseInt(value, parsed) || parsed < 0) {
+                return false;
+            }
+            decode_threads = parsed;
+            return true;
+        }
+        if (key == "resample") {
+            return parseBool(value, resample);
+        }
+        if (key == "pcm_cache") {
+            return parseBool(value, pcm_cache);
+        }
+        if (key == "generator") {
+            GeneratorType type;
+            if (!value.empty() && !toGeneratorType(value, type)) {
+                return false;
+            }
+            generator = value;
+            return true;
+        }
+        if (key == "playback_backend") {
+            if (value != "stream" && value != "simple") {
+                return false;
+            }
+            playback_backend = value;
+            return true;
+        }
+        if (key == "latency_profile") {
+            LatencyProfile profile;
+            if (!findLatencyProfile(value, profile)) {
+                return false;
+            }
+            latency_profile = value;
+            return true;
+        }
+        if (key == "volume") {
+            double parsed;
+            if (!parseDouble(value, parsed) || parsed < 0.0 || parsed > 1.0) {
+                return false;
+            }
+            volume = parsed;
+            return true;
+        }
+        if (key == "fade_in_ms") {
+            return parseInt(value, fade_in_ms);
+        }
+        if (key == "fade_out_ms") {
+            return parseInt(value, fade_out_ms);
+        }
+        if (key == "loop_crossfade_ms") {
+            return parseInt(value, loop_crossfade_ms);
+        }
+        if (key == "fade_shape") {
+            if (value != "linear" && value != "exponential") {
+                return false;
+            }
+            fade_shape = value;
+            return true;
+        }
+        if (key == "cache_dir") {
+            cache_dir = value;
+            return true;
+        }
+        if (key == "detection_mode") {
+            if (value != "monitor" && value != "streams") {
+                return false;
+            }
+            detection_mode = value;
+            return true;
+        }
+        if (key == "monitor_profile") {
+            if (value != "native" && value != "lowrate" && value != "peak") {
+                return false;
+            }
+            monitor_profile = value;
+            return true;
+        }
+        if (key == "monitor_rate") {
+            int parsed;
+            if (!parseInt(value, parsed) || parsed <= 0) {
+                return false;
+            }
+            monitor_rate = parsed;
+            return true;
+        }
+        if (key == "control_socket") {
+            control_socket = value;
+            return true;
+        }
+        if (key == "metrics_file") {
+            metrics_file = value;
+            return true;
+        }
+        if (key == "metrics_interval_ms") {
+            return parseInt(value, metrics_interval_ms);
+        }
+        if (key == "detector") {
+            if (value != "mean" && value != "ewma" && value != "peak") {
+                return false;
+            }
+            detector.type = value;
+            return true;
+        }
+        if (key == "detector_window_ms") {
+            return parseDouble(value, detector.window_ms);
+        }
+        if (key == "detector_attack_ms") {
+            return parseDouble(value, detector.attack_ms);
+        }
+        if (key == "detector_release_ms") {
+            return parseDouble(value, detector.release_ms);
+        }
+        if (key == "activity_threshold") {
+            return parseDouble(value, detector.activity_threshold);
+        }
+        if (key == "release_threshold") {
+            return parseDouble(value, detector.release_threshold);
+        }
+        if (key == "resume_delay_ms") {
+            return parseInt(value, detector.resume_delay_ms);
+        }
+        return false;
+    }
+
+} //ambient
\ No newline at end of file
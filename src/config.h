@@ -0,0 +1,50 @@
+#pragma once
+
+#include "activity_detector.h"
+
+#include <string>
+#include <vector>
+
+namespace ambient {
+
+    // One layer of the mix: a track or generator name at its own level.
+    struct LayerSettings {
+        std::string source;
+        double volume = 1.0;
+    };
+
+    // Runtime settings, read from a "key = value" file. Missing keys keep
+    // their defaults.
+    struct Config {
+        std::string track_path;
+        std::vector<std::string> playlist;          // files or directories, in order
+        std::string playlist_order = "sequential";
+        std::string generator;          // pink | brown | rain | wind; replaces the tracks
+        std::vector<LayerSettings> layers;          // mixed together; replace all of the above
+        bool streaming = true;
+        int decode_threads = 0;         // full decodes; 0: one per core
+        bool pcm_cache = true;
+        std::string playback_backend = "stream";
+        std::string latency_profile = "balanced";  // responsive | balanced | power-saver
+        double volume = 1.0;
+        int fade_in_ms = 1000;
+        int fade_out_ms = 300;
+        std::string fade_shape = "linear";
+        int loop_crossfade_ms = 500;
+        bool resample = true;
+        std::string cache_dir;
+        std::string detection_mode = "monitor";
+        std::string monitor_profile = "native";    // native | lowrate | peak
+        int monitor_rate = 8000;                    // lowrate capture rate
+        std::string metrics_file;       // empty: $XDG_RUNTIME_DIR/desktop_ambient.prom
+        int metrics_interval_ms = 10000;
+        std::string control_socket;     // empty: $XDG_RUNTIME_DIR/desktop_ambient.sock
+        DetectorSettings detector;
+
+        static std::string defaultPath();
+        static Config load(const std::string& path);
+
+        bool set(const std::string& key, const std::string& value);
+    };
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "control_server.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace ambient {
+
+    bool parseControlCommand(const std::string& line, ControlCommand& command, std::string& error) {
+        std::istringstream in(line);
+        std::string verb;
+        in >> verb;
+
+        if (verb == "pause") {
+            command.type = ControlCommand::Type::Pause;
+        } else if (verb == "resume") {
+            command.type = ControlCommand::Type::Resume;
+        } else if (verb == "next") {
+            command.type = ControlCommand::Type::Next;
+        } else if (verb == "reload") {
+            command.type = ControlCommand::Type::Reload;
+        } else if (verb == "volume") {
+            std::string value;
+            in >> value;
+            char* end = nullptr;
+            command.value = std::strtod(value.c_str(), &end);
+            if (value.empty() || *end != '\0' || command.value < 0.0 || command.value > 1.0) {
+                error = "volume takes a level between 0 and 1";
+                return false;
+            }
+            command.type = ControlCommand::Type::Volume;
+        } else {
+            error = "unknown command '" + verb + "'";
+            return false;
+        }
+
+        std::string extra;
+        if (in >> extra) {
+            error = "unexpected argument '" + extra + "'";
+            return false;
+        }
+        return true;
+    }
+
+    ControlServer::~ControlServer() {
+        close();
+    }
+
+    bool ControlServer::open(const std::string& path) {
+        close();
+        last_error.clear();
+
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            last_error = "invalid socket path '" + path + "'";
+            return false;
+        }
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (sock < 0) {
+            last_error = "socket failed: " + std::string(strerror(errno));
+            return false;
+        }
+
+        // A socket file nobody answers on is left over from a crash.
+        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+            ::close(sock);
+            last_error = path + " is in use by another instance";
+            return false;
+        }
+        unlink(path.c_str());
+
+        if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            chmod(path.c_str(), 0600) < 0 ||
+            listen(sock, 8) < 0) {
+            last_error = "bind/listen failed: " + std::string(strerror(errno));
+            ::close(sock);
+            return false;
+        }
+
+        fd = sock;
+        this->path = path;
+        return true;
+    }
+
+    void ControlServer::close() {
+        if (fd >= 0) {
+            ::close(fd);
+            unlink(path.c_str());
+            fd = -1;
+        }
+    }
+
+    int ControlServer::getFd() const {
+        return fd;
+    }
+
+    // Clients get a short timeout each way, so a stalled one cannot hold up
+    // the caller's loop for long.
+    void ControlServer::serve(const Handler& handler) {
+        int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            return;
+        }
+
+        timeval timeout = {CLIENT_TIMEOUT_MS / 1000, (CLIENT_TIMEOUT_MS % 1000) * 1000};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        std::string request;
+        char buffer[64];
+        while (request.size() < MAX_REQUEST && request.find('\n') == std::string::npos) {
+            ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            request.append(buffer, static_cast<size_t>(n));
+        }
+
+        request = request.substr(0, request.find_first_of("\r\n"));
+        std::string reply = handler(request) + "\n";
+        send(client, reply.data(), reply.size(), MSG_NOSIGNAL);
+        ::close(client);
+    }
+
+    const std::string& ControlServer::getLastError() const {
+        return last_error;
+    }
+
+    std::string ControlServer::defaultPath() {
+        if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime) {
+            return std::string(runtime) + "/desktop_ambient.sock";
+        }
+        return "";
+    }
+
+} //ambient
\ No newline at end of file
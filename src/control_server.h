@@ -0,0 +1,64 @@
+#pragma once
+
+#include "config.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace ambient {
+
+    // A request from the control socket for the reactor to carry out.
+    struct ControlCommand {
+        enum class Type {
+            Pause,    // hold playback until Resume, whatever the monitor says
+            Resume,   // release the hold; the monitor decides again
+            Volume,   // value in [0, 1]
+            Next,     // skip to the next playlist track
+            Reload,   // apply the runtime settings of `config`
+        };
+
+        Type type = Type::Pause;
+        double value = 0.0;
+        std::unique_ptr<Config> config;
+    };
+
+    // Parses one request line ("pause", "volume 0.4", ...). "status" is
+    // answered by the caller and is not a command.
+    bool parseControlCommand(const std::string& line, ControlCommand& command, std::string& error);
+
+    // Unix-domain stream socket taking one request line per connection and
+    // answering with one line. The owner polls getFd() and calls serve()
+    // when it is readable.
+    class ControlServer {
+    public:
+        using Handler = std::function<std::string(const std::string& request)>;
+
+        ControlServer() = default;
+        ~ControlServer();
+
+        ControlServer(const ControlServer&) = delete;
+        ControlServer& operator=(const ControlServer&) = delete;
+
+        bool open(const std::string& path);
+        void close();
+
+        int getFd() const;
+        void serve(const Handler& handler);
+
+        const std::string& getLastError() const;
+
+        // $XDG_RUNTIME_DIR/desktop_ambient.sock, or empty without a runtime
+        // directory.
+        static std::string defaultPath();
+
+    private:
+        int fd = -1;
+        std::string path;
+        std::string last_error;
+
+        static constexpr size_t MAX_REQUEST = 256;
+        static constexpr int CLIENT_TIMEOUT_MS = 1000;
+    };
+
+} //ambient
\ No newline at end of file
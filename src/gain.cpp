@@ -0,0 +1,254 @@
+#include "gain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace ambient {
+
+    namespace {
+
+        // Exponential ramps cannot reach zero, so they run to -60 dB and
+        // snap to the target on the last frame.
+        constexpr float EXP_FLOOR = 0.001f;
+
+        void gainS16Scalar(void* data, size_t samples, const float* gains) {
+            int16_t* s = static_cast<int16_t*>(data);
+            for (size_t i = 0; i < samples; ++i) {
+                float v = std::nearbyint(s[i] * gains[i]);
+                s[i] = static_cast<int16_t>(std::min(32767.0f, std::max(-32768.0f, v)));
+            }
+        }
+
+        void gainS32Scalar(void* data, size_t samples, const float* gains) {
+            int32_t* s = static_cast<int32_t*>(data);
+            for (size_t i = 0; i < samples; ++i) {
+                double v = std::nearbyint(static_cast<double>(s[i]) * gains[i]);
+                s[i] = static_cast<int32_t>(std::min(2147483647.0, std::max(-2147483648.0, v)));
+            }
+        }
+
+        void gainFloatScalar(void* data, size_t samples, const float* gains) {
+            float* s = static_cast<float*>(data);
+            for (size_t i = 0; i < samples; ++i) {
+                s[i] *= gains[i];
+            }
+        }
+
+#if defined(AMBIENT_SIMD_X86)
+
+        void gainS16Sse2(void* data, size_t samples, const float* gains) {
+            int16_t* s = static_cast<int16_t*>(data);
+            size_t i = 0;
+
+            for (; i + 8 <= samples; i += 8) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+                __m128 flo = _mm_mul_ps(_mm_cvtepi32_ps(lo), _mm_loadu_ps(gains + i));
+                __m128 fhi = _mm_mul_ps(_mm_cvtepi32_ps(hi), _mm_loadu_ps(gains + i + 4));
+                __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(flo), _mm_cvtps_epi32(fhi));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(s + i), packed);
+            }
+
+            gainS16Scalar(s + i, samples - i, gains + i);
+        }
+
+        void gainFloatSse2(void* data, size_t samples, const float* gains) {
+            float* s = static_cast<float*>(data);
+            size_t i = 0;
+
+            for (; i + 4 <= samples; i += 4) {
+                _mm_storeu_ps(s + i, _mm_mul_ps(_mm_loadu_ps(s + i), _mm_loadu_ps(gains + i)));
+            }
+
+            gainFloatScalar(s + i, samples - i, gains + i);
+        }
+
+        AMBIENT_TARGET_AVX2 void gainS16Avx2(void* data, size_t samples, const float* gains) {
+            int16_t* s = static_cast<int16_t*>(data);
+            size_t i = 0;
+
+            for (; i + 16 <= samples; i += 16) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+                __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+                __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1));
+                __m256 flo = _mm256_mul_ps(_mm256_cvtepi32_ps(lo), _mm256_loadu_ps(gains + i));
+                __m256 fhi = _mm256_mul_ps(_mm256_cvtepi32_ps(hi), _mm256_loadu_ps(gains + i + 8));
+                // packs works per 128-bit lane; restore sample order afterwards.
+                __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(flo), _mm256_cvtps_epi32(fhi));
+                packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(s + i), packed);
+            }
+
+            gainS16Sse2(s + i, samples - i, gains + i);
+        }
+
+        AMBIENT_TARGET_AVX2 void gainFloatAvx2(void* data, size_t samples, const float* gains) {
+            float* s = static_cast<float*>(data);
+            size_t i = 0;
+
+            for (; i + 8 <= samples; i += 8) {
+                _mm256_storeu_ps(s + i, _mm256_mul_ps(_mm256_loadu_ps(s + i), _mm256_loadu_ps(gains + i)));
+            }
+
+            gainFloatSse2(s + i, samples - i, gains + i);
+        }
+
+#elif defined(AMBIENT_SIMD_NEON)
+
+        void gainS16Neon(void* data, size_t samples, const float* gains) {
+            int16_t* s = static_cast<int16_t*>(data);
+            size_t i = 0;
+
+            for (; i + 8 <= samples; i += 8) {
+                int16x8_t x = vld1q_s16(s + i);
+                float32x4_t flo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), vld1q_f32(gains + i));
+                float32x4_t fhi = vmulq_f32(vcvtq_f32_s32(vmovl_high_s16(x)), vld1q_f32(gains + i + 4));
+                int16x8_t packed = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(flo)), vqmovn_s32(vcvtnq_s32_f32(fhi)));
+                vst1q_s16(s + i, packed);
+            }
+
+            gainS16Scalar(s + i, samples - i, gains + i);
+        }
+
+        void gainFloatNeon(void* data, size_t samples, const float* gains) {
+            float* s = static_cast<float*>(data);
+            size_t i = 0;
+
+            for (; i + 4 <= samples; i += 4) {
+                vst1q_f32(s + i, vmulq_f32(vld1q_f32(s + i), vld1q_f32(gains + i)));
+            }
+
+            gainFloatScalar(s + i, samples - i, gains + i);
+        }
+
+#endif
+
+    } // namespace
+
+    GainKernel selectGainKernel(SampleFormat format, SimdLevel level) {
+        switch (format) {
+            case SampleFormat::S16LE:
+                switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+                    case SimdLevel::Avx2: return gainS16Avx2;
+                    case SimdLevel::Sse2: return gainS16Sse2;
+#elif defined(AMBIENT_SIMD_NEON)
+                    case SimdLevel::Neon: return gainS16Neon;
+#endif
+                    default: return gainS16Scalar;
+                }
+            case SampleFormat::S32LE:
+                return gainS32Scalar;
+            default:
+                switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+                    case SimdLevel::Avx2: return gainFloatAvx2;
+                    case SimdLevel::Sse2: return gainFloatSse2;
+#elif defined(AMBIENT_SIMD_NEON)
+                    case SimdLevel::Neon: return gainFloatNeon;
+#endif
+                    default: return gainFloatScalar;
+                }
+        }
+    }
+
+    void GainRamp::setFormat(SampleFormat new_format, unsigned new_channels) {
+        format = new_format;
+        channels = std::max(1u, new_channels);
+        kernel = selectGainKernel(format);
+    }
+
+    void GainRamp::setGain(float new_gain) {
+        gain = target = new_gain;
+        remaining = 0;
+    }
+
+    void GainRamp::rampTo(float new_target, size_t frames, RampShape new_shape) {
+        if (frames == 0) {
+            setGain(new_target);
+            return;
+        }
+
+        target = new_target;
+        shape = new_shape;
+        remaining = frames;
+
+        if (shape == RampShape::Exponential) {
+            gain = std::max(gain, EXP_FLOOR);
+            step = std::pow(std::max(target, EXP_FLOOR) / gain, 1.0f / frames);
+        } else {
+            step = (target - gain) / frames;
+        }
+    }
+
+    float GainRamp::getGain() const {
+        return gain;
+    }
+
+    float GainRamp::getTarget() const {
+        return target;
+    }
+
+    bool GainRamp::isRamping() const {
+        return remaining > 0;
+    }
+
+    size_t GainRamp::getRemaining() const {
+        return remaining;
+    }
+
+    bool GainRamp::isSilent() const {
+        return remaining == 0 && gain == 0.0f;
+    }
+
+    void GainRamp::fillBlock(float* gains, size_t frames) {
+        for (size_t f = 0; f < frames; ++f) {
+            if (remaining > 0) {
+                gain = shape == RampShape::Exponential ? gain * step : gain + step;
+                if (--remaining == 0) {
+                    gain = target;
+                }
+            }
+            for (unsigned c = 0; c < channels; ++c) {
+                *gains++ = gain;
+            }
+        }
+    }
+
+    void GainRamp::process(void* data, size_t frames) {
+        if (remaining == 0) {
+            if (gain == 1.0f) {
+                return;
+            }
+            if (gain == 0.0f) {
+                memset(data, 0, frames * channels * bytesPerSample(format));
+                return;
+            }
+        }
+
+        float gains[BLOCK_SAMPLES];
+        const size_t block_frames = std::max<size_t>(1, BLOCK_SAMPLES / channels);
+        uint8_t* bytes = static_cast<uint8_t*>(data);
+        bool block_constant = false;
+
+        while (frames > 0) {
+            size_t n = std::min(frames, block_frames);
+
+            // A block filled after the ramp finished holds one value and
+            // can be reused for the rest of the buffer.
+            if (!block_constant) {
+                bool steady = remaining == 0;
+                fillBlock(gains, n);
+                block_constant = steady;
+            }
+
+            kernel(bytes, n * channels, gains);
+            bytes += n * channels * bytesPerSample(format);
+            frames -= n;
+        }
+    }
+
+} //ambient
\ No newline at end of file
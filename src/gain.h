@@ -0,0 +1,55 @@
+#pragma once
+
+#include "sample_format.h"
+#include "simd.h"
+
+#include <cstddef>
+
+namespace ambient {
+
+    enum class RampShape {
+        Linear,
+        Exponential,
+    };
+
+    // Multiplies `samples` interleaved samples in place by per-sample gains.
+    using GainKernel = void (*)(void* data, size_t samples, const float* gains);
+
+    GainKernel selectGainKernel(SampleFormat format, SimdLevel level = detectSimdLevel());
+
+    // Sample-accurate gain with linear or exponential ramps between levels.
+    // A steady unity gain leaves the buffer untouched and a steady zero gain
+    // clears it.
+    class GainRamp {
+    public:
+        void setFormat(SampleFormat format, unsigned channels);
+
+        void setGain(float gain);
+        void rampTo(float gain, size_t frames, RampShape shape);
+
+        float getGain() const;
+        float getTarget() const;
+        bool isRamping() const;
+        // Frames left in the current ramp.
+        size_t getRemaining() const;
+        bool isSilent() const;
+
+        void process(void* data, size_t frames);
+
+    private:
+        void fillBlock(float* gains, size_t frames);
+
+        SampleFormat format = SampleFormat::S16LE;
+        unsigned channels = 2;
+        GainKernel kernel = selectGainKernel(SampleFormat::S16LE);
+
+        float gain = 1.0f;
+        float target = 1.0f;
+        float step = 0.0f;
+        RampShape shape = RampShape::Linear;
+        size_t remaining = 0;
+
+        static constexpr size_t BLOCK_SAMPLES = 512;
+    };
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,290 @@
+#include "generator_source.h"
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ambient {
+
+    namespace {
+
+        // The top 24 bits of a lane, signed, scaled into [-1, 1).
+        constexpr float NOISE_SCALE = 1.0f / 8388608.0f;
+
+        constexpr double PI = 3.14159265358979323846;
+
+        // Two drift LFOs whose periods (about 32 s and 52 s) never line up.
+        constexpr double LFO_RATE_HZ = 0.031;
+        constexpr double LFO_RATIO = 1.6180339887;
+
+        // Output levels that put every type near -18 dBFS RMS.
+        constexpr float PINK_LEVEL = 0.64f;
+        constexpr float BROWN_LEVEL = 0.62f;
+        constexpr float RAIN_LEVEL = 0.82f;
+        constexpr float WIND_LEVEL = 0.82f;
+
+        constexpr double RAIN_HIGHPASS_HZ = 500.0;
+        constexpr double DROP_DECAY_MS = 4.0;
+        constexpr double DROPS_PER_SECOND = 25.0;
+        constexpr float DROP_GAIN = 0.6f;
+        constexpr double WIND_CUTOFF_HZ = 450.0;
+        constexpr float WIND_Q = 2.0f;
+
+        inline uint32_t xorshift(uint32_t x) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            return x;
+        }
+
+        void noiseScalar(uint32_t* lanes, float* out, size_t samples) {
+            for (size_t i = 0; i < samples; ++i) {
+                uint32_t& x = lanes[i % NOISE_LANES];
+                x = xorshift(x);
+                out[i] = static_cast<float>(static_cast<int32_t>(x) >> 8) * NOISE_SCALE;
+            }
+        }
+
+        // Paul Kellet's refined pink filter: -3 dB/octave within 0.05 dB
+        // above 9 Hz at 44.1 kHz and near enough at other rates.
+        inline float pinkFilter(std::array<float, 7>& b, float w) {
+            b[0] = 0.99886f * b[0] + w * 0.0555179f;
+            b[1] = 0.99332f * b[1] + w * 0.0750759f;
+            b[2] = 0.96900f * b[2] + w * 0.1538520f;
+            b[3] = 0.86650f * b[3] + w * 0.3104856f;
+            b[4] = 0.55000f * b[4] + w * 0.5329522f;
+            b[5] = -0.7616f * b[5] - w * 0.0168980f;
+            float pink = b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + w * 0.5362f;
+            b[6] = w * 0.115926f;
+            return pink * 0.11f;
+        }
+
+        inline float dbToGain(double db) {
+            return static_cast<float>(std::pow(10.0, db / 20.0));
+        }
+
+#if defined(AMBIENT_SIMD_X86)
+
+        inline __m128i xorshiftSse2(__m128i x) {
+            x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+            x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+            return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+        }
+
+        void noiseSse2(uint32_t* lanes, float* out, size_t samples) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes + 4));
+            const __m128 scale = _mm_set1_ps(NOISE_SCALE);
+            size_t i = 0;
+
+            for (; i + NOISE_LANES <= samples; i += NOISE_LANES) {
+                a = xorshiftSse2(a);
+                b = xorshiftSse2(b);
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(a, 8)), scale));
+                _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(b, 8)), scale));
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), a);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 4), b);
+            noiseScalar(lanes, out + i, samples - i);
+        }
+
+        AMBIENT_TARGET_AVX2 void noiseAvx2(uint32_t* lanes, float* out, size_t samples) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes));
+            const __m256 scale = _mm256_set1_ps(NOISE_SCALE);
+            size_t i = 0;
+
+            for (; i + NOISE_LANES <= samples; i += NOISE_LANES) {
+                x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+                x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+                x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+                _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(x, 8)), scale));
+            }
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), x);
+            noiseScalar(lanes, out + i, samples - i);
+        }
+
+#elif defined(AMBIENT_SIMD_NEON)
+
+        inline uint32x4_t xorshiftNeon(uint32x4_t x) {
+            x = veorq_u32(x, vshlq_n_u32(x, 13));
+            x = veorq_u32(x, vshrq_n_u32(x, 17));
+            return veorq_u32(x, vshlq_n_u32(x, 5));
+        }
+
+        void noiseNeon(uint32_t* lanes, float* out, size_t samples) {
+            uint32x4_t a = vld1q_u32(lanes);
+            uint32x4_t b = vld1q_u32(lanes + 4);
+            size_t i = 0;
+
+            for (; i + NOISE_LANES <= samples; i += NOISE_LANES) {
+                a = xorshiftNeon(a);
+                b = xorshiftNeon(b);
+                vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vshrq_n_s32(vreinterpretq_s32_u32(a), 8)), NOISE_SCALE));
+                vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vshrq_n_s32(vreinterpretq_s32_u32(b), 8)), NOISE_SCALE));
+            }
+
+            vst1q_u32(lanes, a);
+            vst1q_u32(lanes + 4, b);
+            noiseScalar(lanes, out + i, samples - i);
+        }
+
+#endif
+
+    } // namespace
+
+    NoiseKernel selectNoiseKernel(SimdLevel level) {
+        switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+            case SimdLevel::Avx2: return noiseAvx2;
+            case SimdLevel::Sse2: return noiseSse2;
+#elif defined(AMBIENT_SIMD_NEON)
+            case SimdLevel::Neon: return noiseNeon;
+#endif
+            default: return noiseScalar;
+        }
+    }
+
+    bool toGeneratorType(const std::string& name, GeneratorType& type) {
+        if (name == "pink") type = GeneratorType::Pink;
+        else if (name == "brown") type = GeneratorType::Brown;
+        else if (name == "rain") type = GeneratorType::Rain;
+        else if (name == "wind") type = GeneratorType::Wind;
+        else return false;
+        return true;
+    }
+
+    GeneratorSource::GeneratorSource(GeneratorType type, uint32_t rate, unsigned channels, SampleFormat format,
+                                     uint32_t seed, SimdLevel level)
+        : type(type), rate(rate ? rate : DEFAULT_RATE), channels(std::max(1u, std::min(channels, MAX_CHANNELS))),
+          format(format), noise(selectNoiseKernel(level)), gain_kernel(selectGainKernel(SampleFormat::Float32LE, level)) {
+        // Spread the seed over every generator; xorshift must not start at 0.
+        uint32_t x = seed;
+        for (uint32_t& lane : lanes) {
+            x = x * 1664525u + 1013904223u;
+            lane = x ? x : 1;
+        }
+        for (ChannelState& s : state) {
+            x = x * 1664525u + 1013904223u;
+            s.drop_rng = x ? x : 1;
+        }
+        lfo_phase[0] = 2.0 * PI * (seed & 0xffff) / 65536.0;
+        lfo_phase[1] = 2.0 * PI * (seed >> 16) / 65536.0;
+
+        highpass_coeff = static_cast<float>(1.0 / (1.0 + 2.0 * PI * RAIN_HIGHPASS_HZ / this->rate));
+        drop_decay = static_cast<float>(std::exp(-1000.0 / (DROP_DECAY_MS * this->rate)));
+    }
+
+    size_t GeneratorSource::read(uint8_t* out, size_t bytes) {
+        const size_t frame_bytes = bytesPerSample(format) * channels;
+        const size_t frames = bytes / frame_bytes;
+
+        for (size_t done = 0; done < frames;) {
+            size_t n = std::min(BLOCK_FRAMES, frames - done);
+            renderBlock(n);
+            floatToPcm(block.data(), n * channels, format, out + done * frame_bytes);
+            done += n;
+        }
+        return frames * frame_bytes;
+    }
+
+    void GeneratorSource::setLooping([[maybe_unused]]bool looping) {
+    }
+
+    // Advances both LFOs by one block and returns their blend in [-1, 1].
+    float GeneratorSource::advanceLfo(size_t frames) {
+        const double step = 2.0 * PI * LFO_RATE_HZ * frames / rate;
+        lfo_phase[0] = std::fmod(lfo_phase[0] + step, 2.0 * PI);
+        lfo_phase[1] = std::fmod(lfo_phase[1] + step * LFO_RATIO, 2.0 * PI);
+        return static_cast<float>(0.6 * std::sin(lfo_phase[0]) + 0.4 * std::sin(lfo_phase[1]));
+    }
+
+    // Noise for the whole block comes from the vector kernel; the colour
+    // and shaping filters are recursive and run per channel; the level
+    // ramps across the block through the gain kernel. Modulation is
+    // evaluated once per block, a few milliseconds, far faster than it
+    // moves.
+    void GeneratorSource::renderBlock(size_t frames) {
+        const size_t samples = frames * channels;
+        noise(lanes.data(), white.data(), samples);
+
+        const float drift = advanceLfo(frames);
+        float target = 0.0f;
+
+        switch (type) {
+            case GeneratorType::Pink:
+                target = PINK_LEVEL * dbToGain(1.5 * drift);
+                for (size_t i = 0; i < samples; ++i) {
+                    block[i] = pinkFilter(state[i % channels].pink, white[i]);
+                }
+                break;
+
+            case GeneratorType::Brown:
+                target = BROWN_LEVEL * dbToGain(1.5 * drift);
+                for (size_t i = 0; i < samples; ++i) {
+                    ChannelState& s = state[i % channels];
+                    s.brown = (s.brown + 0.02f * white[i]) / 1.02f;
+                    block[i] = s.brown * 3.5f;
+                }
+                break;
+
+            // A highpassed pink bed with sparse, quickly decaying bursts of
+            // white noise for the drops; denser when the LFO rises.
+            case GeneratorType::Rain: {
+                target = RAIN_LEVEL * dbToGain(2.0 * drift);
+                const double density = DROPS_PER_SECOND * (1.0 + 0.6 * drift);
+                const uint32_t threshold = static_cast<uint32_t>(4294967295.0 * std::min(1.0, density / rate));
+                for (size_t i = 0; i < samples; ++i) {
+                    ChannelState& s = state[i % channels];
+                    float pink = pinkFilter(s.pink, white[i]);
+                    s.highpass = highpass_coeff * (s.highpass + pink - s.highpass_in);
+                    s.highpass_in = pink;
+
+                    s.drop_rng = xorshift(s.drop_rng);
+                    if (s.drop_rng < threshold) {
+                        s.drop = 0.5f + 0.5f * std::fabs(white[i]);
+                    }
+                    s.drop *= drop_decay;
+                    block[i] = s.highpass + white[i] * s.drop * DROP_GAIN;
+                }
+                break;
+            }
+
+            // Pink noise through a resonant band-pass (a TPT state-variable
+            // filter) whose centre the LFO sweeps over about two octaves,
+            // with some of the low-pass output kept for body.
+            case GeneratorType::Wind: {
+                target = WIND_LEVEL * dbToGain(6.0 * drift);
+                const double cutoff = WIND_CUTOFF_HZ * std::pow(2.0, 1.2 * drift);
+                const float g = static_cast<float>(std::tan(PI * cutoff / rate));
+                const float k = 1.0f / WIND_Q;
+                const float a1 = 1.0f / (1.0f + g * (g + k));
+                const float a2 = g * a1;
+                const float a3 = g * a2;
+                for (size_t i = 0; i < samples; ++i) {
+                    ChannelState& s = state[i % channels];
+                    float v0 = pinkFilter(s.pink, white[i]);
+                    float v3 = v0 - s.ic2;
+                    float v1 = a1 * s.ic1 + a2 * v3;
+                    float v2 = s.ic2 + a2 * s.ic1 + a3 * v3;
+                    s.ic1 = 2.0f * v1 - s.ic1;
+                    s.ic2 = 2.0f * v2 - s.ic2;
+                    block[i] = v1 + 0.5f * v2;
+                }
+                break;
+            }
+        }
+
+        const float step = (target - level) / frames;
+        for (size_t f = 0; f < frames; ++f) {
+            float g = level + step * (f + 1);
+            for (unsigned c = 0; c < channels; ++c) {
+                gains[f * channels + c] = g;
+            }
+        }
+        gain_kernel(block.data(), samples, gains.data());
+        level = target;
+    }
+
+} //ambient
\ No newline at end of file
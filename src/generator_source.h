@@ -0,0 +1,88 @@
+#pragma once
+
+#include "audio_source.h"
+#include "gain.h"
+#include "simd.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ambient {
+
+    // Independent xorshift32 generators the noise kernels interleave, one
+    // per output sample in turn.
+    constexpr size_t NOISE_LANES = 8;
+
+    // Fills `samples` floats with uniform white noise in [-1, 1), advancing
+    // `lanes`. Every level produces the same sequence.
+    using NoiseKernel = void (*)(uint32_t* lanes, float* out, size_t samples);
+
+    NoiseKernel selectNoiseKernel(SimdLevel level = detectSimdLevel());
+
+    enum class GeneratorType {
+        Pink,
+        Brown,
+        Rain,
+        Wind,
+    };
+
+    // "pink", "brown", "rain" or "wind"; false for anything else.
+    bool toGeneratorType(const std::string& name, GeneratorType& type);
+
+    // Synthesises ambience as it plays instead of reading stored PCM:
+    // coloured noise, shaped into a rain bed with droplets or a wind bed
+    // through a swept resonant filter, its level and colour drifting with
+    // slow LFOs at incommensurate rates so it never repeats. All state is
+    // fixed-size, so read() does not allocate and the source takes a few
+    // kilobytes.
+    class GeneratorSource : public AudioSource {
+    public:
+        GeneratorSource(GeneratorType type, uint32_t rate, unsigned channels, SampleFormat format, uint32_t seed,
+                        SimdLevel level = detectSimdLevel());
+
+        size_t read(uint8_t* out, size_t bytes) override;
+        // Generated sound has no end to loop at.
+        void setLooping(bool looping) override;
+
+        static constexpr unsigned MAX_CHANNELS = 2;
+        static constexpr uint32_t DEFAULT_RATE = 48000;
+
+    private:
+        struct ChannelState {
+            std::array<float, 7> pink{};
+            float brown = 0.0f;
+            float highpass = 0.0f;     // last input and output of the rain highpass
+            float highpass_in = 0.0f;
+            float drop = 0.0f;         // envelope of the current droplet
+            uint32_t drop_rng = 1;
+            float ic1 = 0.0f;          // wind filter integrators
+            float ic2 = 0.0f;
+        };
+
+        void renderBlock(size_t frames);
+        float advanceLfo(size_t frames);
+
+        GeneratorType type;
+        uint32_t rate;
+        unsigned channels;
+        SampleFormat format;
+        NoiseKernel noise;
+        GainKernel gain_kernel;
+
+        std::array<uint32_t, NOISE_LANES> lanes{};
+        std::array<ChannelState, MAX_CHANNELS> state{};
+        double lfo_phase[2] = {0.0, 0.0};
+        float level = 0.0f;            // gain reached at the end of the last block
+
+        float highpass_coeff = 0.0f;
+        float drop_decay = 0.0f;
+
+        static constexpr size_t BLOCK_FRAMES = 256;
+        std::array<float, BLOCK_FRAMES * MAX_CHANNELS> white{};
+        std::array<float, BLOCK_FRAMES * MAX_CHANNELS> block{};
+        std::array<float, BLOCK_FRAMES * MAX_CHANNELS> gains{};
+    };
+
+} //ambient
\ No newline at end of file
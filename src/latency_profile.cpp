@@ -0,0 +1,74 @@
+#include "latency_profile.h"
+
+#include <sstream>
+
+namespace ambient {
+
+    namespace {
+
+        const LatencyProfile PROFILES[] = {
+            {"responsive", 40, 10, 10},
+            {"balanced", 200, 50, 40},
+            {"power-saver", 2000, 500, 250},
+            {nullptr, 0, 0, 0},
+        };
+
+        uint32_t msToBytes(int ms, const pa_sample_spec& spec) {
+            return static_cast<uint32_t>(pa_usec_to_bytes(static_cast<pa_usec_t>(ms) * 1000, &spec));
+        }
+
+        double bytesToMs(uint32_t bytes, const pa_sample_spec& spec) {
+            return pa_bytes_to_usec(bytes, &spec) / 1000.0;
+        }
+
+    } // namespace
+
+    bool findLatencyProfile(const std::string& name, LatencyProfile& profile) {
+        for (const LatencyProfile* p = PROFILES; p->name; ++p) {
+            if (name == p->name) {
+                profile = *p;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const LatencyProfile* latencyProfiles() {
+        return PROFILES;
+    }
+
+    // maxlength and prebuf stay with the server: the largest buffer it
+    // allows, and starting once tlength is queued.
+    pa_buffer_attr playbackBufferAttr(const LatencyProfile& profile, const pa_sample_spec& spec) {
+        pa_buffer_attr attr;
+        attr.maxlength = static_cast<uint32_t>(-1);
+        attr.tlength = msToBytes(profile.target_ms, spec);
+        attr.prebuf = static_cast<uint32_t>(-1);
+        attr.minreq = msToBytes(profile.request_ms, spec);
+        attr.fragsize = static_cast<uint32_t>(-1);
+        return attr;
+    }
+
+    pa_buffer_attr recordBufferAttr(int fragment_ms, const pa_sample_spec& spec) {
+        pa_buffer_attr attr;
+        attr.maxlength = static_cast<uint32_t>(-1);
+        attr.tlength = static_cast<uint32_t>(-1);
+        attr.prebuf = static_cast<uint32_t>(-1);
+        attr.minreq = static_cast<uint32_t>(-1);
+        attr.fragsize = msToBytes(fragment_ms, spec);
+        return attr;
+    }
+
+    std::string describeBufferAttr(const pa_buffer_attr& attr, const pa_sample_spec& spec, bool playback) {
+        std::ostringstream out;
+        out.precision(3);
+        if (playback) {
+            out << "tlength " << bytesToMs(attr.tlength, spec) << " ms, minreq " << bytesToMs(attr.minreq, spec)
+                << " ms, prebuf " << bytesToMs(attr.prebuf, spec) << " ms";
+        } else {
+            out << "fragsize " << bytesToMs(attr.fragsize, spec) << " ms";
+        }
+        return out.str();
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <pulse/pulseaudio.h>
+
+#include <string>
+
+namespace ambient {
+
+    // Buffering asked of the server for the playback and monitor streams.
+    // Small buffers let a pause be heard sooner and let the monitor see
+    // other audio sooner, at the cost of more wakeups on both sides.
+    struct LatencyProfile {
+        const char* name;
+        int target_ms;      // playback tlength: audio queued ahead of the sink
+        int request_ms;     // playback minreq: smallest refill, so the write period
+        int fragment_ms;    // monitor fragsize: audio per read callback
+    };
+
+    // "responsive", "balanced" or "power-saver"; false for anything else.
+    bool findLatencyProfile(const std::string& name, LatencyProfile& profile);
+
+    // The profiles from most to least responsive, terminated by a null name.
+    const LatencyProfile* latencyProfiles();
+
+    pa_buffer_attr playbackBufferAttr(const LatencyProfile& profile, const pa_sample_spec& spec);
+    pa_buffer_attr recordBufferAttr(int fragment_ms, const pa_sample_spec& spec);
+
+    // "tlength 200 ms, minreq 50 ms, ..." for the attributes the server
+    // actually granted.
+    std::string describeBufferAttr(const pa_buffer_attr& attr, const pa_sample_spec& spec, bool playback);
+
+} //ambient
\ No newline at end of file
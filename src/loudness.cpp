@@ -0,0 +1,255 @@
+#include "loudness.h"
+
+#include <cstdint>
+
+namespace ambient {
+
+    namespace {
+
+        template <SampleFormat Format> struct SampleTraits;
+
+        template <> struct SampleTraits<SampleFormat::S16LE> {
+            using type = int16_t;
+            static constexpr double SCALE_SQ = 1.0 / (32768.0 * 32768.0);
+        };
+
+        template <> struct SampleTraits<SampleFormat::S32LE> {
+            using type = int32_t;
+            static constexpr double SCALE_SQ = 1.0 / (2147483648.0 * 2147483648.0);
+        };
+
+        template <> struct SampleTraits<SampleFormat::Float32LE> {
+            using type = float;
+            static constexpr double SCALE_SQ = 1.0;
+        };
+
+        template <SampleFormat Format>
+        using SumSquares = double (*)(const typename SampleTraits<Format>::type* s, size_t n);
+
+        template <SampleFormat Format, SumSquares<Format> Sum>
+        double meanSquare(const void* data, size_t samples) {
+            if (samples == 0) {
+                return 0.0;
+            }
+            using T = typename SampleTraits<Format>::type;
+            return Sum(static_cast<const T*>(data), samples) * SampleTraits<Format>::SCALE_SQ / samples;
+        }
+
+        // Scalar reference kernels. S16 squares are exact in 64-bit integers.
+
+        double sumSquaresS16Scalar(const int16_t* s, size_t n) {
+            uint64_t total = 0;
+            for (size_t i = 0; i < n; ++i) {
+                total += static_cast<uint64_t>(static_cast<int32_t>(s[i]) * s[i]);
+            }
+            return static_cast<double>(total);
+        }
+
+        template <typename T>
+        double sumSquaresScalar(const T* s, size_t n) {
+            double total = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                double v = s[i];
+                total += v * v;
+            }
+            return total;
+        }
+
+#if defined(AMBIENT_SIMD_X86)
+
+        // madd of two -32768 squares is 2^31, which only fits unsigned, so
+        // each 32-bit pair sum is zero-extended before accumulating.
+        double sumSquaresS16Sse2(const int16_t* s, size_t n) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i acc = zero;
+            size_t i = 0;
+
+            for (; i + 8 <= n; i += 8) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+                __m128i sq = _mm_madd_epi16(x, x);
+                acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+                acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+            }
+
+            uint64_t lanes[2];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+            return static_cast<double>(lanes[0] + lanes[1]) + sumSquaresS16Scalar(s + i, n - i);
+        }
+
+        double sumSquaresS32Sse2(const int32_t* s, size_t n) {
+            __m128d acc0 = _mm_setzero_pd();
+            __m128d acc1 = _mm_setzero_pd();
+            size_t i = 0;
+
+            for (; i + 4 <= n; i += 4) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+                __m128d lo = _mm_cvtepi32_pd(x);
+                __m128d hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+                acc0 = _mm_add_pd(acc0, _mm_mul_pd(lo, lo));
+                acc1 = _mm_add_pd(acc1, _mm_mul_pd(hi, hi));
+            }
+
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+            return lanes[0] + lanes[1] + sumSquaresScalar(s + i, n - i);
+        }
+
+        double sumSquaresFloatSse2(const float* s, size_t n) {
+            __m128d acc0 = _mm_setzero_pd();
+            __m128d acc1 = _mm_setzero_pd();
+            size_t i = 0;
+
+            for (; i + 4 <= n; i += 4) {
+                __m128 x = _mm_loadu_ps(s + i);
+                __m128d lo = _mm_cvtps_pd(x);
+                __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+                acc0 = _mm_add_pd(acc0, _mm_mul_pd(lo, lo));
+                acc1 = _mm_add_pd(acc1, _mm_mul_pd(hi, hi));
+            }
+
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+            return lanes[0] + lanes[1] + sumSquaresScalar(s + i, n - i);
+        }
+
+        AMBIENT_TARGET_AVX2 double sumSquaresS16Avx2(const int16_t* s, size_t n) {
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i acc = zero;
+            size_t i = 0;
+
+            for (; i + 16 <= n; i += 16) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+                __m256i sq = _mm256_madd_epi16(x, x);
+                acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(sq, zero));
+                acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(sq, zero));
+            }
+
+            uint64_t lanes[4];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+            return static_cast<double>(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+                   sumSquaresS16Scalar(s + i, n - i);
+        }
+
+        AMBIENT_TARGET_AVX2 double sumSquaresS32Avx2(const int32_t* s, size_t n) {
+            __m256d acc0 = _mm256_setzero_pd();
+            __m256d acc1 = _mm256_setzero_pd();
+            size_t i = 0;
+
+            for (; i + 8 <= n; i += 8) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+                __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(x));
+                __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1));
+                acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(lo, lo));
+                acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(hi, hi));
+            }
+
+            double lanes[4];
+            _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+            return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumSquaresScalar(s + i, n - i);
+        }
+
+        AMBIENT_TARGET_AVX2 double sumSquaresFloatAvx2(const float* s, size_t n) {
+            __m256d acc0 = _mm256_setzero_pd();
+            __m256d acc1 = _mm256_setzero_pd();
+            size_t i = 0;
+
+            for (; i + 8 <= n; i += 8) {
+                __m256 x = _mm256_loadu_ps(s + i);
+                __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+                __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+                acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(lo, lo));
+                acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(hi, hi));
+            }
+
+            double lanes[4];
+            _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+            return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumSquaresScalar(s + i, n - i);
+        }
+
+#elif defined(AMBIENT_SIMD_NEON)
+
+        double sumSquaresS16Neon(const int16_t* s, size_t n) {
+            int64x2_t acc = vdupq_n_s64(0);
+            size_t i = 0;
+
+            for (; i + 8 <= n; i += 8) {
+                int16x8_t x = vld1q_s16(s + i);
+                acc = vpadalq_s32(acc, vmull_s16(vget_low_s16(x), vget_low_s16(x)));
+                acc = vpadalq_s32(acc, vmull_high_s16(x, x));
+            }
+
+            return static_cast<double>(vaddvq_s64(acc)) + sumSquaresS16Scalar(s + i, n - i);
+        }
+
+        double sumSquaresS32Neon(const int32_t* s, size_t n) {
+            float64x2_t acc0 = vdupq_n_f64(0.0);
+            float64x2_t acc1 = vdupq_n_f64(0.0);
+            size_t i = 0;
+
+            for (; i + 4 <= n; i += 4) {
+                int32x4_t x = vld1q_s32(s + i);
+                float64x2_t lo = vcvtq_f64_s64(vmovl_s32(vget_low_s32(x)));
+                float64x2_t hi = vcvtq_f64_s64(vmovl_high_s32(x));
+                acc0 = vfmaq_f64(acc0, lo, lo);
+                acc1 = vfmaq_f64(acc1, hi, hi);
+            }
+
+            return vaddvq_f64(vaddq_f64(acc0, acc1)) + sumSquaresScalar(s + i, n - i);
+        }
+
+        double sumSquaresFloatNeon(const float* s, size_t n) {
+            float64x2_t acc0 = vdupq_n_f64(0.0);
+            float64x2_t acc1 = vdupq_n_f64(0.0);
+            size_t i = 0;
+
+            for (; i + 4 <= n; i += 4) {
+                float32x4_t x = vld1q_f32(s + i);
+                float64x2_t lo = vcvt_f64_f32(vget_low_f32(x));
+                float64x2_t hi = vcvt_high_f64_f32(x);
+                acc0 = vfmaq_f64(acc0, lo, lo);
+                acc1 = vfmaq_f64(acc1, hi, hi);
+            }
+
+            return vaddvq_f64(vaddq_f64(acc0, acc1)) + sumSquaresScalar(s + i, n - i);
+        }
+
+#endif
+
+    } // namespace
+
+    LoudnessKernel selectLoudnessKernel(SampleFormat format, SimdLevel level) {
+        switch (format) {
+            case SampleFormat::S16LE:
+                switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+                    case SimdLevel::Avx2: return meanSquare<SampleFormat::S16LE, sumSquaresS16Avx2>;
+                    case SimdLevel::Sse2: return meanSquare<SampleFormat::S16LE, sumSquaresS16Sse2>;
+#elif defined(AMBIENT_SIMD_NEON)
+                    case SimdLevel::Neon: return meanSquare<SampleFormat::S16LE, sumSquaresS16Neon>;
+#endif
+                    default: return meanSquare<SampleFormat::S16LE, sumSquaresS16Scalar>;
+                }
+            case SampleFormat::S32LE:
+                switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+                    case SimdLevel::Avx2: return meanSquare<SampleFormat::S32LE, sumSquaresS32Avx2>;
+                    case SimdLevel::Sse2: return meanSquare<SampleFormat::S32LE, sumSquaresS32Sse2>;
+#elif defined(AMBIENT_SIMD_NEON)
+                    case SimdLevel::Neon: return meanSquare<SampleFormat::S32LE, sumSquaresS32Neon>;
+#endif
+                    default: return meanSquare<SampleFormat::S32LE, sumSquaresScalar<int32_t>>;
+                }
+            default:
+                switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+                    case SimdLevel::Avx2: return meanSquare<SampleFormat::Float32LE, sumSquaresFloatAvx2>;
+                    case SimdLevel::Sse2: return meanSquare<SampleFormat::Float32LE, sumSquaresFloatSse2>;
+#elif defined(AMBIENT_SIMD_NEON)
+                    case SimdLevel::Neon: return meanSquare<SampleFormat::Float32LE, sumSquaresFloatNeon>;
+#endif
+                    default: return meanSquare<SampleFormat::Float32LE, sumSquaresScalar<float>>;
+                }
+        }
+    }
+
+} //ambient
\ No newline at end of file
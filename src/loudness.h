@@ -0,0 +1,17 @@
+#pragma once
+
+#include "sample_format.h"
+#include "simd.h"
+
+#include <cstddef>
+
+namespace ambient {
+
+    // Mean square of `samples` interleaved samples, normalised so that a
+    // full-scale signal gives 1.0. Channels are not distinguished: the caller
+    // passes whole frames and the result is the per-sample average.
+    using LoudnessKernel = double (*)(const void* data, size_t samples);
+
+    LoudnessKernel selectLoudnessKernel(SampleFormat format, SimdLevel level = detectSimdLevel());
+
+} //ambient
\ No newline at end of file
@@ -1,29 +1,127 @@
 #include "audio_controller.h"
-#include <iostream>
+#include "config.h"
+#include "control_server.h"
+#include "trace.h"
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
 #include <csignal>
-#include <atomic>
-
-std::atomic<bool> gaRunning{true};
-
-void signalHandler(int signal) {
-    gaRunning = signal != 0;
-}
+#include <cstring>
+#include <iostream>
 
-int main() {
-    std::signal(SIGINT, signalHandler);
-    std::signal(SIGTERM, signalHandler);
+int main(int argc, char** argv) {
+    // Termination signals arrive through a signalfd. They are blocked
+    // before any thread starts, so every thread inherits the mask.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+#ifdef AMBIENT_TRACE
+    // SIGUSR1 dumps the trace rings and keeps the service running.
+    sigaddset(&signals, SIGUSR1);
+#endif
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        std::cerr << "Failed to create signalfd: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    
+    const std::string config_path = ambient::Config::defaultPath();
+    ambient::Config config = ambient::Config::load(config_path);
+    if (argc > 1) {
+        config.playlist.assign(argv + 1, argv + argc);
+        config.generator.clear();
+        config.layers.clear();
+    }
+    
+    ambient::AudioController controller(config);
+    
+    ambient::ControlServer control;
+    std::string control_path = config.control_socket.empty() ? ambient::ControlServer::defaultPath() : config.control_socket;
+    if (control_path.empty() || !control.open(control_path)) {
+        std::cerr << "Control socket disabled: "
+                  << (control_path.empty() ? "no runtime directory" : control.getLastError()) << std::endl;
+    }
     
-    ambient::AudioController controller;
+    auto handleRequest = [&](const std::string& request) -> std::string {
+        if (request == "status") {
+            return controller.status();
+        }
+        
+        ambient::ControlCommand command;
+        std::string error;
+        if (!ambient::parseControlCommand(request, command, error)) {
+            return "error " + error;
+        }
+        
+        // The file is read here so the reactor only swaps settings.
+        if (command.type == ambient::ControlCommand::Type::Reload) {
+            command.config = std::make_unique<ambient::Config>(ambient::Config::load(config_path));
+            if (argc > 1) {
+                command.config->playlist = config.playlist;
+                command.config->generator.clear();
+                command.config->layers.clear();
+            }
+        }
+        return controller.submit(std::move(command)) ? "ok" : "error busy";
+    };
     
+    AMBIENT_TRACE_THREAD("main");
     std::cout << "Starting sound service..." << std::endl;
     controller.start();
     
-    while (gaRunning) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+    bool running = true;
+    bool failed = false;
+    while (running) {
+        // The control socket may be disabled; poll ignores negative fds.
+        pollfd fds[3] = {{signal_fd, POLLIN, 0}, {controller.getFailureFd(), POLLIN, 0}, {control.getFd(), POLLIN, 0}};
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "poll failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        
+        if (fds[0].revents & POLLIN) {
+            signalfd_siginfo info;
+            if (read(signal_fd, &info, sizeof(info)) != sizeof(info)) {
+                continue;
+            }
+#ifdef AMBIENT_TRACE
+            if (info.ssi_signo == SIGUSR1) {
+                std::string trace_path = ambient::trace::defaultPath();
+                std::string error;
+                if (ambient::trace::writeChromeTrace(trace_path, error)) {
+                    std::cout << "Trace written to " << trace_path << std::endl;
+                } else {
+                    std::cerr << "Failed to write trace: " << error << std::endl;
+                }
+                continue;
+            }
+#endif
+            std::cout << "Received " << strsignal(static_cast<int>(info.ssi_signo)) << std::endl;
+            running = false;
+        }
+        
+        if (fds[1].revents & POLLIN) {
+            std::cerr << "Lost the sound server, exiting" << std::endl;
+            failed = true;
+            running = false;
+        }
+        
+        if (fds[2].revents & POLLIN) {
+            control.serve(handleRequest);
+        }
     }
     
     controller.stop();
+    control.close();
+    close(signal_fd);
     std::cout << "Sound service stopped." << std::endl;
     
-    return 0;
+    return failed ? 1 : 0;
 }
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "mapped_file.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+namespace ambient {
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+        : data(std::exchange(other.data, nullptr)),
+          size(std::exchange(other.size, 0)),
+          last_error(std::move(other.last_error)) {}
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            data = std::exchange(other.data, nullptr);
+            size = std::exchange(other.size, 0);
+            last_error = std::move(other.last_error);
+        }
+        return *this;
+    }
+
+    bool MappedFile::open(const std::string& path) {
+        close();
+        last_error.clear();
+
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            last_error = "open failed: " + std::string(strerror(errno));
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            last_error = "fstat failed: " + std::string(strerror(errno));
+            ::close(fd);
+            return false;
+        }
+
+        if (st.st_size <= 0) {
+            last_error = "File is empty";
+            ::close(fd);
+            return false;
+        }
+
+        void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (mapping == MAP_FAILED) {
+            last_error = "mmap failed: " + std::string(strerror(errno));
+            return false;
+        }
+
+        data = static_cast<const uint8_t*>(mapping);
+        size = static_cast<size_t>(st.st_size);
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (data) {
+            munmap(const_cast<uint8_t*>(data), size);
+            data = nullptr;
+            size = 0;
+        }
+    }
+
+    bool MappedFile::isOpen() const {
+        return data != nullptr;
+    }
+
+    const uint8_t* MappedFile::getData() const {
+        return data;
+    }
+
+    size_t MappedFile::getSize() const {
+        return size;
+    }
+
+    const std::string& MappedFile::getLastError() const {
+        return last_error;
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace ambient {
+
+    // Read-only memory mapping of a whole file. Pages are file-backed and
+    // clean, so the kernel can drop whatever is not being touched.
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        bool open(const std::string& path);
+        void close();
+        bool isOpen() const;
+
+        const uint8_t* getData() const;
+        size_t getSize() const;
+        const std::string& getLastError() const;
+
+    private:
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        std::string last_error;
+    };
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "metrics.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace ambient {
+
+    namespace {
+
+        std::string formatValue(double v) {
+            char text[32];
+            snprintf(text, sizeof(text), "%.9g", v);
+            return text;
+        }
+
+        void appendHeader(std::string& out, const std::string& name, const std::string& help, const char* type) {
+            out += "# HELP " + name + " " + help + "\n";
+            out += "# TYPE " + name + " " + type + "\n";
+        }
+
+    } // namespace
+
+    Histogram::Histogram(std::vector<double> bounds)
+        : bounds(std::move(bounds)), buckets(new std::atomic<uint64_t>[this->bounds.size() + 1]) {
+        std::sort(this->bounds.begin(), this->bounds.end());
+        for (size_t i = 0; i <= this->bounds.size(); ++i) {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Histogram::observe(double v) {
+        size_t index = static_cast<size_t>(std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin());
+        buckets[index].fetch_add(1, std::memory_order_relaxed);
+
+        double current = sum.load(std::memory_order_relaxed);
+        while (!sum.compare_exchange_weak(current, current + v, std::memory_order_relaxed)) {
+        }
+    }
+
+    const std::vector<double>& Histogram::getBounds() const {
+        return bounds;
+    }
+
+    uint64_t Histogram::getBucket(size_t index) const {
+        return buckets[index].load(std::memory_order_relaxed);
+    }
+
+    double Histogram::getSum() const {
+        return sum.load(std::memory_order_relaxed);
+    }
+
+    std::vector<double> Histogram::exponentialBuckets(double start, double factor, size_t count) {
+        std::vector<double> result;
+        for (size_t i = 0; i < count; ++i, start *= factor) {
+            result.push_back(start);
+        }
+        return result;
+    }
+
+    Counter& MetricsRegistry::addCounter(const std::string& name, const std::string& help) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters.emplace_back(name, help).metric;
+    }
+
+    Gauge& MetricsRegistry::addGauge(const std::string& name, const std::string& help) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return gauges.emplace_back(name, help).metric;
+    }
+
+    Histogram& MetricsRegistry::addHistogram(const std::string& name, const std::string& help, std::vector<double> bounds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return histograms.emplace_back(name, help, std::move(bounds)).metric;
+    }
+
+    std::string MetricsRegistry::render() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string out;
+
+        for (const auto& entry : counters) {
+            appendHeader(out, entry.name, entry.help, "counter");
+            out += entry.name + " " + std::to_string(entry.metric.get()) + "\n";
+        }
+
+        for (const auto& entry : gauges) {
+            appendHeader(out, entry.name, entry.help, "gauge");
+            out += entry.name + " " + formatValue(entry.metric.get()) + "\n";
+        }
+
+        // Buckets are read one by one while callbacks keep observing, so the
+        // count is derived from them rather than kept separately.
+        for (const auto& entry : histograms) {
+            appendHeader(out, entry.name, entry.help, "histogram");
+            const std::vector<double>& bounds = entry.metric.getBounds();
+            uint64_t cumulative = 0;
+
+            for (size_t i = 0; i <= bounds.size(); ++i) {
+                cumulative += entry.metric.getBucket(i);
+                std::string le = i < bounds.size() ? formatValue(bounds[i]) : "+Inf";
+                out += entry.name + "_bucket{le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+            }
+            out += entry.name + "_sum " + formatValue(entry.metric.getSum()) + "\n";
+            out += entry.name + "_count " + std::to_string(cumulative) + "\n";
+        }
+
+        return out;
+    }
+
+    bool MetricsRegistry::writeFile(const std::string& path, std::string& error) const {
+        std::string text = render();
+        std::string tmp_path = path + ".tmp";
+
+        int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            error = "open failed: " + std::string(strerror(errno));
+            return false;
+        }
+
+        const char* data = text.data();
+        size_t left = text.size();
+        while (left > 0) {
+            ssize_t written = write(fd, data, left);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                error = "write failed: " + std::string(strerror(errno));
+                ::close(fd);
+                unlink(tmp_path.c_str());
+                return false;
+            }
+            data += written;
+            left -= static_cast<size_t>(written);
+        }
+        ::close(fd);
+
+        if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+            error = "rename failed: " + std::string(strerror(errno));
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    std::string MetricsRegistry::defaultPath() {
+        if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime) {
+            return std::string(runtime) + "/desktop_ambient.prom";
+        }
+        return "";
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ambient {
+
+    // Metric handles are updated from audio callbacks with relaxed atomics
+    // only; nothing on the update path locks or allocates.
+    class Counter {
+    public:
+        void add(uint64_t n = 1) {
+            value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t get() const {
+            return value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<uint64_t> value{0};
+    };
+
+    class Gauge {
+    public:
+        void set(double v) {
+            value.store(v, std::memory_order_relaxed);
+        }
+
+        double get() const {
+            return value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<double> value{0.0};
+    };
+
+    // Fixed upper bounds chosen at registration; the +Inf bucket is implied.
+    class Histogram {
+    public:
+        explicit Histogram(std::vector<double> bounds);
+
+        void observe(double v);
+
+        const std::vector<double>& getBounds() const;
+        uint64_t getBucket(size_t index) const;  // index == bounds size: +Inf
+        double getSum() const;
+
+        static std::vector<double> exponentialBuckets(double start, double factor, size_t count);
+
+    private:
+        std::vector<double> bounds;
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+        std::atomic<double> sum{0.0};
+    };
+
+    // Owns the service's metrics and renders them in the Prometheus text
+    // format. Registration and rendering take a lock; updates through the
+    // returned handles never do, and handles stay valid for the registry's
+    // lifetime.
+    class MetricsRegistry {
+    public:
+        Counter& addCounter(const std::string& name, const std::string& help);
+        Gauge& addGauge(const std::string& name, const std::string& help);
+        Histogram& addHistogram(const std::string& name, const std::string& help, std::vector<double> bounds);
+
+        std::string render() const;
+
+        // Replaces `path` atomically, so scrapers never see a partial file.
+        bool writeFile(const std::string& path, std::string& error) const;
+
+        // $XDG_RUNTIME_DIR/desktop_ambient.prom, or empty without a runtime
+        // directory.
+        static std::string defaultPath();
+
+    private:
+        template <typename T>
+        struct Entry {
+            template <typename... Args>
+            Entry(std::string name, std::string help, Args&&... args)
+                : name(std::move(name)), help(std::move(help)), metric(std::forward<Args>(args)...) {}
+
+            std::string name;
+            std::string help;
+            T metric;
+        };
+
+        mutable std::mutex mutex;
+        std::deque<Entry<Counter>> counters;
+        std::deque<Entry<Gauge>> gauges;
+        std::deque<Entry<Histogram>> histograms;
+    };
+
+} //ambient
\ No newline at end of file
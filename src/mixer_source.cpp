@@ -0,0 +1,284 @@
+#include "mixer_source.h"
+#include "resampler.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ambient {
+
+    namespace {
+
+        constexpr float S16_SCALE = 1.0f / 32768.0f;
+        constexpr float S32_SCALE = 1.0f / 2147483648.0f;
+
+        void mixS16Scalar(float* mix, const void* in, size_t samples) {
+            const int16_t* s = static_cast<const int16_t*>(in);
+            for (size_t i = 0; i < samples; ++i) {
+                mix[i] += static_cast<float>(s[i]) * S16_SCALE;
+            }
+        }
+
+        void mixS32Scalar(float* mix, const void* in, size_t samples) {
+            const int32_t* s = static_cast<const int32_t*>(in);
+            for (size_t i = 0; i < samples; ++i) {
+                mix[i] += static_cast<float>(s[i]) * S32_SCALE;
+            }
+        }
+
+        void mixFloatScalar(float* mix, const void* in, size_t samples) {
+            const float* s = static_cast<const float*>(in);
+            for (size_t i = 0; i < samples; ++i) {
+                mix[i] += s[i];
+            }
+        }
+
+#if defined(AMBIENT_SIMD_X86)
+
+        void mixS16Sse2(float* mix, const void* in, size_t samples) {
+            const int16_t* s = static_cast<const int16_t*>(in);
+            const __m128 scale = _mm_set1_ps(S16_SCALE);
+            size_t i = 0;
+
+            for (; i + 8 <= samples; i += 8) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+                _mm_storeu_ps(mix + i, _mm_add_ps(_mm_loadu_ps(mix + i), _mm_mul_ps(_mm_cvtepi32_ps(lo), scale)));
+                _mm_storeu_ps(mix + i + 4, _mm_add_ps(_mm_loadu_ps(mix + i + 4), _mm_mul_ps(_mm_cvtepi32_ps(hi), scale)));
+            }
+
+            mixS16Scalar(mix + i, s + i, samples - i);
+        }
+
+        void mixS32Sse2(float* mix, const void* in, size_t samples) {
+            const int32_t* s = static_cast<const int32_t*>(in);
+            const __m128 scale = _mm_set1_ps(S32_SCALE);
+            size_t i = 0;
+
+            for (; i + 4 <= samples; i += 4) {
+                __m128 x = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+                _mm_storeu_ps(mix + i, _mm_add_ps(_mm_loadu_ps(mix + i), _mm_mul_ps(x, scale)));
+            }
+
+            mixS32Scalar(mix + i, s + i, samples - i);
+        }
+
+        void mixFloatSse2(float* mix, const void* in, size_t samples) {
+            const float* s = static_cast<const float*>(in);
+            size_t i = 0;
+
+            for (; i + 4 <= samples; i += 4) {
+                _mm_storeu_ps(mix + i, _mm_add_ps(_mm_loadu_ps(mix + i), _mm_loadu_ps(s + i)));
+            }
+
+            mixFloatScalar(mix + i, s + i, samples - i);
+        }
+
+        AMBIENT_TARGET_AVX2 void mixS16Avx2(float* mix, const void* in, size_t samples) {
+            const int16_t* s = static_cast<const int16_t*>(in);
+            const __m256 scale = _mm256_set1_ps(S16_SCALE);
+            size_t i = 0;
+
+            for (; i + 16 <= samples; i += 16) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+                __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+                __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+                _mm256_storeu_ps(mix + i, _mm256_add_ps(_mm256_loadu_ps(mix + i), _mm256_mul_ps(lo, scale)));
+                _mm256_storeu_ps(mix + i + 8, _mm256_add_ps(_mm256_loadu_ps(mix + i + 8), _mm256_mul_ps(hi, scale)));
+            }
+
+            mixS16Sse2(mix + i, s + i, samples - i);
+        }
+
+        AMBIENT_TARGET_AVX2 void mixS32Avx2(float* mix, const void* in, size_t samples) {
+            const int32_t* s = static_cast<const int32_t*>(in);
+            const __m256 scale = _mm256_set1_ps(S32_SCALE);
+            size_t i = 0;
+
+            for (; i + 8 <= samples; i += 8) {
+                __m256 x = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)));
+                _mm256_storeu_ps(mix + i, _mm256_add_ps(_mm256_loadu_ps(mix + i), _mm256_mul_ps(x, scale)));
+            }
+
+            mixS32Sse2(mix + i, s + i, samples - i);
+        }
+
+        AMBIENT_TARGET_AVX2 void mixFloatAvx2(float* mix, const void* in, size_t samples) {
+            const float* s = static_cast<const float*>(in);
+            size_t i = 0;
+
+            for (; i + 8 <= samples; i += 8) {
+                _mm256_storeu_ps(mix + i, _mm256_add_ps(_mm256_loadu_ps(mix + i), _mm256_loadu_ps(s + i)));
+            }
+
+            mixFloatSse2(mix + i, s + i, samples - i);
+        }
+
+#elif defined(AMBIENT_SIMD_NEON)
+
+        void mixS16Neon(float* mix, const void* in, size_t samples) {
+            const int16_t* s = static_cast<const int16_t*>(in);
+            size_t i = 0;
+
+            for (; i + 8 <= samples; i += 8) {
+                int16x8_t x = vld1q_s16(s + i);
+                float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+                float32x4_t hi = vcvtq_f32_s32(vmovl_high_s16(x));
+                vst1q_f32(mix + i, vmlaq_n_f32(vld1q_f32(mix + i), lo, S16_SCALE));
+                vst1q_f32(mix + i + 4, vmlaq_n_f32(vld1q_f32(mix + i + 4), hi, S16_SCALE));
+            }
+
+            mixS16Scalar(mix + i, s + i, samples - i);
+        }
+
+        void mixS32Neon(float* mix, const void* in, size_t samples) {
+            const int32_t* s = static_cast<const int32_t*>(in);
+            size_t i = 0;
+
+            for (; i + 4 <= samples; i += 4) {
+                float32x4_t x = vcvtq_f32_s32(vld1q_s32(s + i));
+                vst1q_f32(mix + i, vmlaq_n_f32(vld1q_f32(mix + i), x, S32_SCALE));
+            }
+
+            mixS32Scalar(mix + i, s + i, samples - i);
+        }
+
+        void mixFloatNeon(float* mix, const void* in, size_t samples) {
+            const float* s = static_cast<const float*>(in);
+            size_t i = 0;
+
+            for (; i + 4 <= samples; i += 4) {
+                vst1q_f32(mix + i, vaddq_f32(vld1q_f32(mix + i), vld1q_f32(s + i)));
+            }
+
+            mixFloatScalar(mix + i, s + i, samples - i);
+        }
+
+#endif
+
+    } // namespace
+
+    MixKernel selectMixKernel(SampleFormat format, SimdLevel level) {
+        switch (format) {
+            case SampleFormat::S16LE:
+                switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+                    case SimdLevel::Avx2: return mixS16Avx2;
+                    case SimdLevel::Sse2: return mixS16Sse2;
+#elif defined(AMBIENT_SIMD_NEON)
+                    case SimdLevel::Neon: return mixS16Neon;
+#endif
+                    default: return mixS16Scalar;
+                }
+            case SampleFormat::S32LE:
+                switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+                    case SimdLevel::Avx2: return mixS32Avx2;
+                    case SimdLevel::Sse2: return mixS32Sse2;
+#elif defined(AMBIENT_SIMD_NEON)
+                    case SimdLevel::Neon: return mixS32Neon;
+#endif
+                    default: return mixS32Scalar;
+                }
+            default:
+                switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+                    case SimdLevel::Avx2: return mixFloatAvx2;
+                    case SimdLevel::Sse2: return mixFloatSse2;
+#elif defined(AMBIENT_SIMD_NEON)
+                    case SimdLevel::Neon: return mixFloatNeon;
+#endif
+                    default: return mixFloatScalar;
+                }
+        }
+    }
+
+    MixerSource::MixerSource(uint32_t rate, unsigned channels, SampleFormat format, SimdLevel level)
+        : rate(rate), channels(channels), format(format), mix_kernel(selectMixKernel(format, level)),
+          scratch(BLOCK_FRAMES * channels * bytesPerSample(format)), mix(BLOCK_FRAMES * channels),
+          mono(BLOCK_FRAMES) {}
+
+    bool MixerSource::addLayer(std::unique_ptr<AudioSource> source, unsigned channels, double volume) {
+        if (!source || (channels != this->channels && channels != 1)) {
+            return false;
+        }
+
+        auto layer = std::make_unique<Layer>();
+        layer->source = std::move(source);
+        layer->channels = channels;
+        layer->gain.setFormat(format, channels);
+        layer->gain.setGain(static_cast<float>(volume));
+        layer->volume = static_cast<float>(volume);
+        layers.push_back(std::move(layer));
+        return true;
+    }
+
+    size_t MixerSource::getLayerCount() const {
+        return layers.size();
+    }
+
+    void MixerSource::setLayerVolume(size_t layer, double volume) {
+        if (layer < layers.size()) {
+            layers[layer]->volume = static_cast<float>(std::max(0.0, std::min(1.0, volume)));
+        }
+    }
+
+    size_t MixerSource::read(uint8_t* out, size_t bytes) {
+        const size_t frame_bytes = bytesPerSample(format) * channels;
+        const size_t frames = bytes / frame_bytes;
+        size_t done = 0;
+
+        while (done < frames) {
+            const size_t n = std::min(BLOCK_FRAMES, frames - done);
+            std::fill(mix.begin(), mix.begin() + n * channels, 0.0f);
+
+            size_t longest = 0;
+            for (auto& layer : layers) {
+                float volume = layer->volume.load(std::memory_order_relaxed);
+                if (volume != layer->gain.getTarget()) {
+                    layer->gain.rampTo(volume, static_cast<size_t>(LAYER_RAMP_MS) * rate / 1000, RampShape::Linear);
+                }
+                if (layer->gain.isSilent()) {
+                    longest = n;
+                    continue;
+                }
+
+                const size_t layer_frame_bytes = bytesPerSample(format) * layer->channels;
+                size_t got = layer->source->read(scratch.data(), n * layer_frame_bytes) / layer_frame_bytes;
+                layer->gain.process(scratch.data(), got);
+                if (layer->channels == channels) {
+                    mix_kernel(mix.data(), scratch.data(), got * channels);
+                } else {
+                    addUpmixed(got);
+                }
+                longest = std::max(longest, got);
+            }
+
+            floatToPcm(mix.data(), longest * channels, format, out + done * frame_bytes);
+            done += longest;
+            if (longest < n) {
+                break;
+            }
+        }
+
+        return done * frame_bytes;
+    }
+
+    // A mono layer is converted on its own, then added to every channel.
+    void MixerSource::addUpmixed(size_t frames) {
+        std::fill(mono.begin(), mono.begin() + frames, 0.0f);
+        mix_kernel(mono.data(), scratch.data(), frames);
+        for (size_t f = 0; f < frames; ++f) {
+            for (unsigned c = 0; c < channels; ++c) {
+                mix[f * channels + c] += mono[f];
+            }
+        }
+    }
+
+    void MixerSource::setLooping(bool looping) {
+        for (auto& layer : layers) {
+            layer->source->setLooping(looping);
+        }
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "audio_source.h"
+#include "gain.h"
+#include "simd.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ambient {
+
+    // Adds `samples` interleaved samples of one format to `mix`, as floats
+    // at full scale 1.0.
+    using MixKernel = void (*)(float* mix, const void* in, size_t samples);
+
+    MixKernel selectMixKernel(SampleFormat format, SimdLevel level = detectSimdLevel());
+
+    // Plays several sources at once as one: rain, a fireplace and room tone
+    // each loop on their own while the player keeps a single stream. Every
+    // layer reads in the output format, goes through its own GainRamp and
+    // is summed in float, so nothing clips until the final conversion. The
+    // cost is one read, gain and add pass per layer; a muted layer is not
+    // read at all.
+    class MixerSource : public AudioSource {
+    public:
+        MixerSource(uint32_t rate, unsigned channels, SampleFormat format, SimdLevel level = detectSimdLevel());
+
+        // `channels` may be the mixer's or 1, which is spread over every
+        // output channel. Layers are added before playback starts.
+        bool addLayer(std::unique_ptr<AudioSource> source, unsigned channels, double volume);
+        size_t getLayerCount() const;
+
+        // Ramps the layer to `volume` over LAYER_RAMP_MS from the next read;
+        // safe from any thread.
+        void setLayerVolume(size_t layer, double volume);
+
+        // Returns short only once every layer has.
+        size_t read(uint8_t* out, size_t bytes) override;
+        void setLooping(bool looping) override;
+
+    private:
+        struct Layer {
+            std::unique_ptr<AudioSource> source;
+            unsigned channels;
+            GainRamp gain;
+            std::atomic<float> volume;
+        };
+
+        void addUpmixed(size_t frames);
+
+        uint32_t rate;
+        unsigned channels;
+        SampleFormat format;
+        MixKernel mix_kernel;
+        std::vector<std::unique_ptr<Layer>> layers;
+        std::vector<uint8_t> scratch;   // one layer's block in the output format
+        std::vector<float> mix;
+        std::vector<float> mono;        // a mono layer before it is spread
+
+        static constexpr size_t BLOCK_FRAMES = 1024;
+        static constexpr int LAYER_RAMP_MS = 500;
+    };
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace ambient {
+
+    // Bounded lock-free queue for many producers and one consumer. Each slot
+    // carries a sequence number: producers claim a position with one CAS on
+    // the tail and publish by bumping the slot's sequence, the consumer
+    // only reads and bumps sequences. push() fails instead of waiting when
+    // the queue is full. Capacity must be a power of two.
+    template <typename T, size_t Capacity>
+    class MpscQueue {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        MpscQueue() {
+            for (size_t i = 0; i < Capacity; ++i) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        bool push(T value) {
+            size_t pos = tail.load(std::memory_order_relaxed);
+            Slot* slot;
+
+            while (true) {
+                slot = &slots[pos & MASK];
+                size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+                if (diff == 0) {
+                    if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->value = std::move(value);
+            slot->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer thread only.
+        bool pop(T& value) {
+            Slot& slot = slots[head & MASK];
+            if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+                return false;
+            }
+
+            value = std::move(slot.value);
+            slot.sequence.store(head + Capacity, std::memory_order_release);
+            ++head;
+            return true;
+        }
+
+    private:
+        struct Slot {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        static constexpr size_t MASK = Capacity - 1;
+
+        Slot slots[Capacity];
+        alignas(64) std::atomic<size_t> tail{0};
+        alignas(64) size_t head = 0;
+    };
+
+} //ambient
\ No newline at end of file
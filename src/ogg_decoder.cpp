@@ -1,9 +1,16 @@
 // ogg_decoder.cpp
 #include "ogg_decoder.h"
+#include "trace.h"
 #include <vorbis/vorbisfile.h>
 #include <iostream>
 #include <cstring>
 #include <sstream>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <system_error>
+#include <thread>
 
 namespace ambient {
 
@@ -60,11 +67,186 @@ namespace ambient {
         return mf->position;
     }
 
+    static bool hasOggSignature(const uint8_t* data, size_t size) {
+        return size >= 4 && data[0] == 'O' && data[1] == 'g' && data[2] == 'g' && data[3] == 'S';
+    }
+
+    static int openMemoryFile(OggMemoryFile* mf, OggVorbis_File* vf) {
+        ov_callbacks callbacks;
+        callbacks.read_func = read_func;
+        callbacks.seek_func = seek_func;
+        callbacks.close_func = close_func;
+        callbacks.tell_func = tell_func;
+
+        return ov_open_callbacks(mf, vf, nullptr, 0, callbacks);
+    }
+
+    // Loop region in frames. After `end` comes a seam of `crossfade` frames
+    // in which the audio following `end` in the file fades out while the
+    // audio following `start` fades in; playback then carries on from
+    // `start + crossfade`. Tracks without loop comments loop the whole file,
+    // their last `crossfade` frames becoming the seam.
+    struct LoopPlan {
+        uint64_t start = 0;
+        uint64_t end = 0;
+        uint64_t crossfade = 0;
+    };
+
+    static bool queryFrames(vorbis_comment* vc, const char* tag, uint64_t& frames) {
+        const char* value = vc ? vorbis_comment_query(vc, tag, 0) : nullptr;
+        if (!value || !*value) {
+            return false;
+        }
+        char* end = nullptr;
+        frames = std::strtoull(value, &end, 10);
+        return *end == '\0';
+    }
+
+    static LoopPlan planLoop(OggVorbis_File* vf, uint64_t total, uint64_t crossfade) {
+        LoopPlan plan;
+        plan.end = total;
+
+        vorbis_comment* vc = ov_comment(vf, -1);
+        uint64_t start = 0, length = 0, end = 0;
+        if (queryFrames(vc, "LOOPSTART", start)) {
+            if (queryFrames(vc, "LOOPLENGTH", length)) {
+                end = start + length;
+            } else if (!queryFrames(vc, "LOOPEND", end)) {
+                end = total;
+            }
+            if (start < end && end <= total) {
+                plan.start = start;
+                plan.end = end;
+                plan.crossfade = std::min({crossfade, total - end, end - start});
+                return plan;
+            }
+        }
+
+        plan.crossfade = std::min(crossfade, total / 2);
+        plan.end = total - plan.crossfade;
+        return plan;
+    }
+
+    // tail = tail * cos + head * sin over a quarter period: the tail leads
+    // in at full level and hands over to the head at constant power.
+    static void crossfadeSeam(int16_t* tail, const int16_t* head, size_t frames, unsigned channels) {
+        for (size_t i = 0; i < frames; ++i) {
+            double theta = (i + 0.5) / frames * (M_PI / 2.0);
+            float head_gain = static_cast<float>(std::sin(theta));
+            float tail_gain = static_cast<float>(std::cos(theta));
+            for (unsigned c = 0; c < channels; ++c) {
+                size_t n = i * channels + c;
+                float v = head[n] * head_gain + tail[n] * tail_gain;
+                tail[n] = static_cast<int16_t>(std::lrintf(std::max(-32768.0f, std::min(32767.0f, v))));
+            }
+        }
+    }
+
+    static bool cancelled(const std::atomic<bool>* cancel) {
+        return cancel && cancel->load(std::memory_order_relaxed);
+    }
+
+    // Reads exactly `bytes` unless the stream ends, fails or is cancelled
+    // first.
+    static size_t readExactly(OggVorbis_File* vf, uint8_t* out, size_t bytes,
+                              const std::atomic<bool>* cancel = nullptr) {
+        size_t filled = 0;
+        int current_section;
+        while (filled < bytes && !cancelled(cancel)) {
+            long read_result = ov_read(vf, reinterpret_cast<char*>(out + filled),
+                                       static_cast<int>(std::min(bytes - filled, static_cast<size_t>(INT_MAX))),
+                                       0, 2, 1, &current_section);
+            if (read_result > 0) {
+                filled += read_result;
+            } else if (read_result != OV_HOLE) {
+                break;
+            }
+        }
+        return filled;
+    }
+
+    // Each range of a parallel decode spans at least this many frames, so
+    // opening a handle stays cheap next to decoding its range.
+    static constexpr uint64_t MIN_RANGE_FRAMES = 1 << 16;
+
+    // Splits [0, total) into one range per thread. Every range gets its own
+    // handle over the same buffer, seeks to its first frame and decodes into
+    // its final slot of `out`; ov_pcm_seek is sample-accurate, so the slots
+    // join without gaps or overlap. False if the track is too short to split
+    // or any range comes up short, in which case the caller decodes serially.
+    static bool decodeRanges(const uint8_t* data, size_t size, uint8_t* out, uint64_t total, size_t frame_size,
+                             unsigned threads, const std::atomic<bool>* cancel) {
+        threads = static_cast<unsigned>(std::min<uint64_t>(threads, total / MIN_RANGE_FRAMES));
+        if (threads < 2) {
+            return false;
+        }
+
+        std::vector<char> ok(threads, 0);
+        auto decodeRange = [&](unsigned index) {
+            uint64_t begin = total * index / threads;
+            uint64_t end = total * (index + 1) / threads;
+            size_t bytes = static_cast<size_t>(end - begin) * frame_size;
+
+            OggMemoryFile mf = {data, size, 0};
+            OggVorbis_File vf;
+            if (openMemoryFile(&mf, &vf) != 0) {
+                return;
+            }
+            ok[index] = ov_pcm_seek(&vf, static_cast<ogg_int64_t>(begin)) == 0 &&
+                        readExactly(&vf, out + begin * frame_size, bytes, cancel) == bytes;
+            ov_clear(&vf);
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        try {
+            for (unsigned i = 1; i < threads; ++i) {
+                workers.emplace_back(decodeRange, i);
+            }
+        } catch (const std::system_error& e) {
+            std::cerr << "Parallel decode unavailable: " << e.what() << std::endl;
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            return false;
+        }
+
+        decodeRange(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        return std::all_of(ok.begin(), ok.end(), [](char range_ok) { return range_ok != 0; });
+    }
+
+    struct OggDecoder::Stream {
+        OggMemoryFile mf;
+        OggVorbis_File vf;
+        LoopPlan loop;
+        std::vector<uint8_t> seam;
+        size_t seam_pos = 0;
+        uint64_t position = 0;
+    };
+
     OggDecoder::OggDecoder() = default;
 
-    OggDecoder::~OggDecoder() = default;
+    OggDecoder::~OggDecoder() {
+        closeStream();
+    }
+
+    void OggDecoder::setCancelFlag(const std::atomic<bool>* cancel) {
+        this->cancel = cancel;
+    }
+
+    void OggDecoder::setLoopCrossfade(int ms) {
+        loop_crossfade_ms = std::max(0, ms);
+    }
+
+    void OggDecoder::setDecodeThreads(unsigned threads) {
+        decode_threads = threads;
+    }
 
     bool OggDecoder::decode(const uint8_t* data, size_t size) {
+        AMBIENT_TRACE_SCOPE("decode");
         std::cout << "Decode staring\n";
         pcm_data.clear();
         last_error.clear();
@@ -74,21 +256,15 @@ namespace ambient {
             return false;
         }
         
-        if (size < 4 || data[0] != 'O' || data[1] != 'g' || data[2] != 'g' || data[3] != 'S') {
+        if (!hasOggSignature(data, size)) {
             last_error = "Invalid OGG signature";
             return false;
         }
         
         OggMemoryFile mf = {data, size, 0};
-        
         OggVorbis_File vf;
-        ov_callbacks callbacks;
-        callbacks.read_func = read_func;
-        callbacks.seek_func = seek_func;
-        callbacks.close_func = close_func;
-        callbacks.tell_func = tell_func;
         
-        int result = ov_open_callbacks(&mf, &vf, nullptr, 0, callbacks);
+        int result = openMemoryFile(&mf, &vf);
         if (result != 0) {
             std::stringstream ss;
             ss << "ov_open_callbacks failed with error: " << result;
@@ -107,13 +283,48 @@ namespace ambient {
         channels = vi->channels;
         bits_per_sample = 16;
         
+        ogg_int64_t total_frames = ov_pcm_total(&vf, -1);
+        if (total_frames > 0) {
+            pcm_data.resize(static_cast<size_t>(total_frames) * channels * (bits_per_sample / 8));
+        }
+        
         const int buffer_size = 4096;
         char pcm_buffer[buffer_size];
+        size_t decoded = 0;
         int current_section;
-        long read_result;
+        long read_result = 0;
         
-        while ((read_result = ov_read(&vf, pcm_buffer, buffer_size, 0, 2, 1, &current_section)) > 0) {
-            pcm_data.insert(pcm_data.end(), pcm_buffer, pcm_buffer + read_result);
+        // Single-link files with a known length can be decoded in ranges on
+        // several cores; `vf` is left untouched for the serial path.
+        unsigned threads = decode_threads ? decode_threads : std::max(1u, std::thread::hardware_concurrency());
+        if (total_frames > 0 && ov_streams(&vf) == 1 &&
+            decodeRanges(data, size, pcm_data.data(), static_cast<uint64_t>(total_frames),
+                         static_cast<size_t>(channels) * (bits_per_sample / 8), threads, cancel)) {
+            decoded = pcm_data.size();
+        } else {
+            // Decode straight into the preallocated buffer; fall back to growing
+            // it only if the stream turns out longer than its reported length.
+            while (!cancelled(cancel)) {
+                if (decoded < pcm_data.size()) {
+                    size_t space = std::min(pcm_data.size() - decoded, static_cast<size_t>(buffer_size));
+                    read_result = ov_read(&vf, reinterpret_cast<char*>(pcm_data.data() + decoded),
+                                          static_cast<int>(space), 0, 2, 1, &current_section);
+                    if (read_result <= 0) break;
+                    decoded += read_result;
+                } else {
+                    read_result = ov_read(&vf, pcm_buffer, buffer_size, 0, 2, 1, &current_section);
+                    if (read_result <= 0) break;
+                    pcm_data.insert(pcm_data.end(), pcm_buffer, pcm_buffer + read_result);
+                    decoded = pcm_data.size();
+                }
+            }
+        }
+        pcm_data.resize(decoded);
+        
+        if (cancelled(cancel)) {
+            last_error = "Decode cancelled";
+            ov_clear(&vf);
+            return false;
         }
         
         if (read_result < 0) {
@@ -124,6 +335,16 @@ namespace ambient {
             return false;
         }
         
+        // Bake the loop seam into the buffer once, right after the loop end,
+        // so playback wraps with a plain copy.
+        const size_t frame_size = static_cast<size_t>(channels) * (bits_per_sample / 8);
+        LoopPlan loop = planLoop(&vf, decoded / frame_size,
+                                 static_cast<uint64_t>(loop_crossfade_ms) * sample_rate / 1000);
+        int16_t* samples = reinterpret_cast<int16_t*>(pcm_data.data());
+        crossfadeSeam(samples + loop.end * channels, samples + loop.start * channels, loop.crossfade, channels);
+        pcm_data.resize((loop.end + loop.crossfade) * frame_size);
+        loop_start = loop.start + loop.crossfade;
+        
         ov_clear(&vf);
         
         if (pcm_data.empty()) {
@@ -134,10 +355,154 @@ namespace ambient {
         return true;
     }
 
+    bool OggDecoder::openStream(const uint8_t* data, size_t size) {
+        closeStream();
+        last_error.clear();
+
+        if (data == nullptr || size == 0) {
+            last_error = "No data provided";
+            return false;
+        }
+
+        if (!hasOggSignature(data, size)) {
+            last_error = "Invalid OGG signature";
+            return false;
+        }
+
+        auto new_stream = std::make_unique<Stream>();
+        new_stream->mf = {data, size, 0};
+
+        int result = openMemoryFile(&new_stream->mf, &new_stream->vf);
+        if (result != 0) {
+            std::stringstream ss;
+            ss << "ov_open_callbacks failed with error: " << result;
+            last_error = ss.str();
+            return false;
+        }
+
+        vorbis_info* vi = ov_info(&new_stream->vf, -1);
+        if (!vi) {
+            last_error = "ov_info failed";
+            ov_clear(&new_stream->vf);
+            return false;
+        }
+
+        sample_rate = vi->rate;
+        channels = vi->channels;
+        bits_per_sample = 16;
+
+        // Same loop as decode(); the blended seam is decoded up front and
+        // played from memory at each loop end. Without a known length the
+        // stream just rewinds at the end of the file.
+        Stream& s = *new_stream;
+        const size_t frame_size = static_cast<size_t>(channels) * (bits_per_sample / 8);
+        ogg_int64_t total = ov_pcm_total(&s.vf, -1);
+        if (total > 0) {
+            s.loop = planLoop(&s.vf, static_cast<uint64_t>(total),
+                              static_cast<uint64_t>(loop_crossfade_ms) * sample_rate / 1000);
+        } else {
+            s.loop.end = UINT64_MAX;
+        }
+
+        if (s.loop.crossfade > 0) {
+            const size_t seam_bytes = s.loop.crossfade * frame_size;
+            std::vector<uint8_t> head(seam_bytes);
+            s.seam.resize(seam_bytes);
+            if (ov_pcm_seek(&s.vf, s.loop.end) != 0 || readExactly(&s.vf, s.seam.data(), seam_bytes) != seam_bytes ||
+                ov_pcm_seek(&s.vf, s.loop.start) != 0 || readExactly(&s.vf, head.data(), seam_bytes) != seam_bytes ||
+                ov_pcm_seek(&s.vf, 0) != 0) {
+                last_error = "Failed to decode loop seam";
+                ov_clear(&s.vf);
+                return false;
+            }
+            crossfadeSeam(reinterpret_cast<int16_t*>(s.seam.data()), reinterpret_cast<const int16_t*>(head.data()),
+                          s.loop.crossfade, channels);
+        }
+        s.seam_pos = s.seam.size();
+
+        loop_start = s.loop.start + s.loop.crossfade;
+        stream = std::move(new_stream);
+        return true;
+    }
+
+    size_t OggDecoder::readStream(uint8_t* out, size_t bytes) {
+        AMBIENT_TRACE_SCOPE("decode_stream");
+        if (!stream) {
+            return 0;
+        }
+
+        Stream& s = *stream;
+        const size_t frame_size = static_cast<size_t>(channels) * (bits_per_sample / 8);
+        size_t filled = 0;
+        bool rewound = false;
+        int current_section;
+
+        while (filled < bytes) {
+            if (s.seam_pos < s.seam.size()) {
+                size_t chunk = std::min(bytes - filled, s.seam.size() - s.seam_pos);
+                memcpy(out + filled, s.seam.data() + s.seam_pos, chunk);
+                filled += chunk;
+                s.seam_pos += chunk;
+                continue;
+            }
+
+            uint64_t left = s.loop.end - s.position;
+            size_t want = std::min(bytes - filled, static_cast<size_t>(std::min<uint64_t>(left * frame_size, INT_MAX)));
+
+            long read_result = want > 0 ? ov_read(&s.vf, reinterpret_cast<char*>(out + filled),
+                                                  static_cast<int>(want), 0, 2, 1, &current_section) : 0;
+            if (read_result > 0) {
+                filled += read_result;
+                s.position += read_result / frame_size;
+                rewound = false;
+            } else if (read_result == 0) {
+                if (!looping) {
+                    break;
+                }
+                // Loop end or end of track: play the seam and wrap. Two
+                // rewinds in a row means the loop has no samples at all, so
+                // give up instead of spinning.
+                s.position = s.loop.start + s.loop.crossfade;
+                if (rewound || ov_pcm_seek(&s.vf, s.position) != 0) {
+                    last_error = "Failed to rewind stream";
+                    break;
+                }
+                s.seam_pos = 0;
+                rewound = true;
+            } else if (read_result != OV_HOLE) {
+                std::stringstream ss;
+                ss << "ov_read failed with error: " << read_result;
+                last_error = ss.str();
+                break;
+            }
+        }
+
+        return filled;
+    }
+
+    void OggDecoder::setLooping(bool looping) {
+        this->looping = looping;
+    }
+
+    void OggDecoder::closeStream() {
+        if (stream) {
+            ov_clear(&stream->vf);
+            stream.reset();
+        }
+    }
+
+    bool OggDecoder::isStreamOpen() const {
+        return stream != nullptr;
+    }
+
     const std::vector<uint8_t>& OggDecoder::getPcmData() const {
         return pcm_data;
     }
 
+    std::vector<uint8_t> OggDecoder::takePcmData() {
+        return std::move(pcm_data);
+    }
+
     uint32_t OggDecoder::getSampleRate() const {
         return sample_rate;
     }
@@ -150,6 +515,10 @@ namespace ambient {
         return bits_per_sample;
     }
 
+    uint64_t OggDecoder::getLoopStart() const {
+        return loop_start;
+    }
+
     const std::string& OggDecoder::getLastError() const {
         return last_error;
     }
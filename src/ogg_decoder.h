@@ -1,8 +1,10 @@
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <memory>
 
 
 namespace ambient {
@@ -11,19 +13,53 @@ namespace ambient {
     public:
         OggDecoder();
         ~OggDecoder();
-        
+
+        // Length of the equal-power crossfade baked into the loop seam;
+        // takes effect on the next decode() or openStream().
+        void setLoopCrossfade(int ms);
+
+        // Threads decode() may split a track across, each decoding its own
+        // range through a separate handle; 0 uses one per core.
+        void setDecodeThreads(unsigned threads);
+
+        // decode() gives up, failing, soon after `*cancel` becomes true;
+        // checked between reads, so it stops within a few packets.
+        void setCancelFlag(const std::atomic<bool>* cancel);
+
         bool decode(const uint8_t* data, size_t size);
         const std::vector<uint8_t>& getPcmData() const;
+        std::vector<uint8_t> takePcmData();
+
+        // Streaming mode: keeps the Vorbis file open over `data` (which must
+        // outlive the stream) and decodes on demand, looping the same way
+        // the decoded buffer does.
+        bool openStream(const uint8_t* data, size_t size);
+        size_t readStream(uint8_t* out, size_t bytes);
+        // With looping off, readStream() returns short at the loop end.
+        void setLooping(bool looping);
+        void closeStream();
+        bool isStreamOpen() const;
+
         uint32_t getSampleRate() const;
         uint8_t getChannels() const;
         uint8_t getBitsPerSample() const;
+        // Frame that playback wraps back to once the decoded buffer ends.
+        uint64_t getLoopStart() const;
         const std::string& getLastError() const;
-        
+
     private:
+        struct Stream;
+
         std::vector<uint8_t> pcm_data;
+        std::unique_ptr<Stream> stream;
         uint32_t sample_rate = 0;
         uint8_t channels = 0;
         uint8_t bits_per_sample = 16;
+        int loop_crossfade_ms = 0;
+        unsigned decode_threads = 1;
+        const std::atomic<bool>* cancel = nullptr;
+        bool looping = true;
+        uint64_t loop_start = 0;
         std::string last_error;
     };
 
@@ -0,0 +1,294 @@
+#include "output_reference.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ambient {
+
+    namespace {
+
+        template <typename T> struct DownmixTraits;
+
+        template <> struct DownmixTraits<int16_t> {
+            static constexpr float SCALE = 1.0f / 32768.0f;
+        };
+
+        template <> struct DownmixTraits<int32_t> {
+            static constexpr float SCALE = 1.0f / 2147483648.0f;
+        };
+
+        template <> struct DownmixTraits<float> {
+            static constexpr float SCALE = 1.0f;
+        };
+
+        template <typename T>
+        void downmix(const void* data, size_t frames, unsigned channels, float* out) {
+            const T* s = static_cast<const T*>(data);
+            const float scale = DownmixTraits<T>::SCALE / channels;
+
+            for (size_t i = 0; i < frames; ++i) {
+                float sum = 0.0f;
+                for (unsigned c = 0; c < channels; ++c) {
+                    sum += static_cast<float>(s[c]);
+                }
+                out[i] = sum * scale;
+                s += channels;
+            }
+        }
+
+        double dotScalar(const float* a, const float* b, size_t n) {
+            double total = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                total += static_cast<double>(a[i]) * b[i];
+            }
+            return total;
+        }
+
+#if defined(AMBIENT_SIMD_X86)
+
+        double dotSse2(const float* a, const float* b, size_t n) {
+            __m128 acc0 = _mm_setzero_ps();
+            __m128 acc1 = _mm_setzero_ps();
+            size_t i = 0;
+
+            for (; i + 8 <= n; i += 8) {
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+            }
+
+            float lanes[4];
+            _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+            return static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3] + dotScalar(a + i, b + i, n - i);
+        }
+
+        AMBIENT_TARGET_AVX2 double dotAvx2(const float* a, const float* b, size_t n) {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            size_t i = 0;
+
+            for (; i + 16 <= n; i += 16) {
+                acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+                acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+            }
+
+            float lanes[8];
+            _mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+            double total = 0.0;
+            for (float lane : lanes) {
+                total += lane;
+            }
+            return total + dotScalar(a + i, b + i, n - i);
+        }
+
+#elif defined(AMBIENT_SIMD_NEON)
+
+        double dotNeon(const float* a, const float* b, size_t n) {
+            float32x4_t acc0 = vdupq_n_f32(0.0f);
+            float32x4_t acc1 = vdupq_n_f32(0.0f);
+            size_t i = 0;
+
+            for (; i + 8 <= n; i += 8) {
+                acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+                acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+            }
+
+            return static_cast<double>(vaddvq_f32(vaddq_f32(acc0, acc1))) + dotScalar(a + i, b + i, n - i);
+        }
+
+#endif
+
+    } // namespace
+
+    DownmixKernel selectDownmixKernel(SampleFormat format) {
+        switch (format) {
+            case SampleFormat::S16LE: return downmix<int16_t>;
+            case SampleFormat::S32LE: return downmix<int32_t>;
+            default: return downmix<float>;
+        }
+    }
+
+    DotKernel selectDotKernel(SimdLevel level) {
+        switch (level) {
+#if defined(AMBIENT_SIMD_X86)
+            case SimdLevel::Avx2: return dotAvx2;
+            case SimdLevel::Sse2: return dotSse2;
+#elif defined(AMBIENT_SIMD_NEON)
+            case SimdLevel::Neon: return dotNeon;
+#endif
+            default: return dotScalar;
+        }
+    }
+
+    OutputReference::OutputReference() : ring(CAPACITY, 0.0f) {
+    }
+
+    void OutputReference::setFormat(SampleFormat format, unsigned channels, uint32_t rate) {
+        std::lock_guard<std::mutex> lock(mutex);
+        downmix = selectDownmixKernel(format);
+        frame_bytes = bytesPerSample(format) * channels;
+        this->channels = channels;
+        sample_rate = rate;
+        written = 0;
+        anchored = false;
+    }
+
+    uint32_t OutputReference::getSampleRate() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sample_rate;
+    }
+
+    void OutputReference::push(const void* data, size_t frames) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+        // Only the most recent CAPACITY frames can ever be read back.
+        if (frames > CAPACITY) {
+            bytes += (frames - CAPACITY) * frame_bytes;
+            written += frames - CAPACITY;
+            frames = CAPACITY;
+        }
+
+        while (frames > 0) {
+            size_t pos = written % CAPACITY;
+            size_t span = std::min(frames, CAPACITY - pos);
+            downmix(bytes, span, channels, ring.data() + pos);
+            bytes += span * frame_bytes;
+            written += span;
+            frames -= span;
+        }
+    }
+
+    // The anchor stays put: the mixer has not moved, only what lies ahead
+    // of it changed.
+    void OutputReference::rewind(size_t frames) {
+        std::lock_guard<std::mutex> lock(mutex);
+        written -= std::min<uint64_t>(frames, written);
+    }
+
+    // The mixer consumes our stream `usec` behind what has been pushed; the
+    // anchor turns that into a frame position that advances with the clock
+    // until the next report.
+    void OutputReference::setQueuedLatency(uint64_t usec) {
+        std::lock_guard<std::mutex> lock(mutex);
+        anchor_frame = static_cast<int64_t>(written) - static_cast<int64_t>(usec * sample_rate / 1000000);
+        anchor_time = std::chrono::steady_clock::now();
+        anchored = true;
+    }
+
+    bool OutputReference::mixedFrame(int64_t& frame) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!anchored) {
+            return false;
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - anchor_time);
+        frame = anchor_frame + elapsed.count() * static_cast<int64_t>(sample_rate) / 1000000;
+        return frame < static_cast<int64_t>(written);
+    }
+
+    float OutputReference::sampleAt(int64_t frame) const {
+        if (frame < 0 || frame >= static_cast<int64_t>(written) ||
+            static_cast<uint64_t>(frame) + CAPACITY < written) {
+            return 0.0f;
+        }
+        return ring[static_cast<size_t>(frame) % CAPACITY];
+    }
+
+    void OutputReference::copy(double start, double step, float* out, size_t frames) const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (step == 1.0 && start == std::floor(start)) {
+            int64_t first = static_cast<int64_t>(start);
+            for (size_t i = 0; i < frames; ++i) {
+                out[i] = sampleAt(first + static_cast<int64_t>(i));
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < frames; ++i) {
+            double pos = start + step * i;
+            double base = std::floor(pos);
+            float frac = static_cast<float>(pos - base);
+            int64_t frame = static_cast<int64_t>(base);
+            out[i] = sampleAt(frame) + (sampleAt(frame + 1) - sampleAt(frame)) * frac;
+        }
+    }
+
+    void ReferenceCanceller::setFormat(SampleFormat format, unsigned channels, uint32_t rate) {
+        downmix = selectDownmixKernel(format);
+        this->channels = channels;
+        sample_rate = rate;
+        search_frames = static_cast<size_t>(SEARCH_MS) * rate / 1000;
+        reset();
+    }
+
+    void ReferenceCanceller::reset() {
+        locked = false;
+        lag = 0;
+    }
+
+    double ReferenceCanceller::explainedFraction(const void* data, size_t frames, const OutputReference& reference, int64_t end_frame) {
+        if (frames == 0) {
+            return 0.0;
+        }
+
+        monitor.resize(frames);
+        downmix(data, frames, channels, monitor.data());
+
+        double mm = dot(monitor.data(), monitor.data(), frames);
+        if (mm <= SILENT_MEAN_SQUARE * frames) {
+            return 0.0;
+        }
+
+        // The window spans the fragment plus the search range on both sides,
+        // resampled onto the monitor's clock when the rates differ.
+        const int64_t search = static_cast<int64_t>(search_frames);
+        const double step = static_cast<double>(reference.getSampleRate()) / sample_rate;
+        window.resize(frames + 2 * search_frames);
+        reference.copy(end_frame - (static_cast<double>(frames) + search) * step, step, window.data(), window.size());
+
+        // A silent window explains nothing at any lag; skip the search.
+        if (dot(window.data(), window.data(), window.size()) <= SILENT_MEAN_SQUARE * window.size()) {
+            reset();
+            return 0.0;
+        }
+
+        // Pick the lag on the head of the fragment: it decides alignment as
+        // well as the whole would at a fraction of the cost.
+        const size_t probe = std::min(frames, PROBE_FRAMES);
+        int64_t lo = locked ? std::max(-search, lag - TRACK_FRAMES) : -search;
+        int64_t hi = locked ? std::min(search, lag + TRACK_FRAMES) : search;
+
+        const float* base = window.data() + search;
+        double rr = dot(base + lo, base + lo, probe);
+        double best_score = -1.0;
+        int64_t best_lag = 0;
+
+        for (int64_t l = lo; l <= hi; ++l) {
+            const float* r = base + l;
+            double mr = dot(monitor.data(), r, probe);
+            double score = rr > SILENT_MEAN_SQUARE * probe ? mr * mr / rr : 0.0;
+            if (score > best_score) {
+                best_score = score;
+                best_lag = l;
+            }
+            if (l < hi) {
+                rr = std::max(0.0, rr + static_cast<double>(r[probe]) * r[probe] - static_cast<double>(r[0]) * r[0]);
+            }
+        }
+
+        const float* r = base + best_lag;
+        double mr = dot(monitor.data(), r, frames);
+        rr = dot(r, r, frames);
+        if (rr <= SILENT_MEAN_SQUARE * frames) {
+            reset();
+            return 0.0;
+        }
+
+        double fraction = std::min(1.0, mr * mr / (rr * mm));
+        locked = fraction > LOCK_FRACTION;
+        lag = best_lag;
+        return fraction;
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "sample_format.h"
+#include "simd.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace ambient {
+
+    // Averages the channels of `frames` interleaved frames into mono floats
+    // at full scale 1.0.
+    using DownmixKernel = void (*)(const void* data, size_t frames, unsigned channels, float* out);
+
+    DownmixKernel selectDownmixKernel(SampleFormat format);
+
+    // Dot product of two float sequences.
+    using DotKernel = double (*)(const float* a, const float* b, size_t n);
+
+    DotKernel selectDotKernel(SimdLevel level = detectSimdLevel());
+
+    // Mono history of what the player has written, indexed by absolute frame
+    // number since the start. The player pushes every rendered chunk and the
+    // amount still queued ahead of the mixer; the monitor side reads back the
+    // stretch that was being mixed when a capture fragment was taken.
+    class OutputReference {
+    public:
+        OutputReference();
+
+        void setFormat(SampleFormat format, unsigned channels, uint32_t rate);
+        uint32_t getSampleRate() const;
+
+        void push(const void* data, size_t frames);
+        // Forgets the last `frames` pushed: the player flushed them before
+        // they played, and pushes what replaces them.
+        void rewind(size_t frames);
+        void setQueuedLatency(uint64_t usec);
+
+        // Estimated frame the mixer is consuming now; false before the
+        // first latency report and once the mixer has passed everything
+        // pushed, as after a pause, when there is nothing left to cancel.
+        bool mixedFrame(int64_t& frame) const;
+
+        // Copies `frames` samples starting at reference position `start`,
+        // advancing by `step` reference frames per output sample (linear
+        // interpolation when not 1). Positions outside the history read 0.
+        void copy(double start, double step, float* out, size_t frames) const;
+
+    private:
+        float sampleAt(int64_t frame) const;
+
+        mutable std::mutex mutex;
+        std::vector<float> ring;
+        uint64_t written = 0;
+
+        DownmixKernel downmix = selectDownmixKernel(SampleFormat::S16LE);
+        size_t frame_bytes = 4;
+        unsigned channels = 2;
+        uint32_t sample_rate = 44100;
+
+        bool anchored = false;
+        int64_t anchor_frame = 0;
+        std::chrono::steady_clock::time_point anchor_time;
+
+        static constexpr size_t CAPACITY = size_t(1) << 18;
+    };
+
+    // Estimates how much of a monitor fragment is our own output. The
+    // reference is aligned by latency, refined by a lag search around that
+    // estimate, and projected out with a least-squares gain so that sink
+    // volume does not matter. Once a lag explains most of the signal only
+    // its neighbours are searched.
+    class ReferenceCanceller {
+    public:
+        void setFormat(SampleFormat format, unsigned channels, uint32_t rate);
+        void reset();
+
+        // Fraction of the fragment's energy explained by the reference, in
+        // [0, 1]. `end_frame` is the reference frame expected to line up
+        // with the end of the fragment.
+        double explainedFraction(const void* data, size_t frames, const OutputReference& reference, int64_t end_frame);
+
+    private:
+        DownmixKernel downmix = selectDownmixKernel(SampleFormat::Float32LE);
+        DotKernel dot = selectDotKernel();
+        unsigned channels = 2;
+        uint32_t sample_rate = 48000;
+        size_t search_frames = 0;
+
+        std::vector<float> monitor;
+        std::vector<float> window;
+
+        bool locked = false;
+        int64_t lag = 0;
+
+        static constexpr int SEARCH_MS = 60;
+        static constexpr int64_t TRACK_FRAMES = 4;
+        static constexpr size_t PROBE_FRAMES = 4096;
+        static constexpr double LOCK_FRACTION = 0.5;
+        static constexpr double SILENT_MEAN_SQUARE = 1e-10;
+    };
+
+} //ambient
\ No newline at end of file
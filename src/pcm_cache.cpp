@@ -0,0 +1,299 @@
+#include "pcm_cache.h"
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace ambient {
+
+    namespace {
+
+        struct CacheHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t header_size;
+            uint64_t key;
+            uint64_t data_size;
+            uint32_t sample_rate;
+            uint8_t channels;
+            uint8_t bits_per_sample;
+            uint8_t sample_format;
+            uint8_t padding;
+            uint64_t loop_start_frame;
+            uint8_t reserved[16];
+        };
+
+        static_assert(sizeof(CacheHeader) == 64, "PCM cache header must stay 64 bytes");
+
+        constexpr char CACHE_MAGIC[8] = {'A', 'M', 'B', 'P', 'C', 'M', '\0', '\0'};
+        constexpr const char* CACHE_SUFFIX = ".pcm";
+        constexpr const char* TMP_INFIX = ".pcm.tmp.";
+
+        constexpr uint64_t HASH_PRIME = 0x9E3779B97F4A7C15ULL;
+
+        uint64_t mix(uint64_t h) {
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCDULL;
+            h ^= h >> 33;
+            h *= 0xC4CEB9FE1A85EC53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+        // Four independent lanes over 8-byte words keep the multiply chain
+        // short enough to hash a large track at memory bandwidth.
+        uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t seed) {
+            uint64_t lanes[4] = {seed, seed + HASH_PRIME, seed ^ 0x5BD1E995ULL, ~seed};
+            size_t i = 0;
+
+            for (; i + 32 <= size; i += 32) {
+                for (int lane = 0; lane < 4; ++lane) {
+                    uint64_t word;
+                    memcpy(&word, data + i + lane * 8, sizeof(word));
+                    lanes[lane] = (lanes[lane] ^ word) * HASH_PRIME;
+                    lanes[lane] = (lanes[lane] << 31) | (lanes[lane] >> 33);
+                }
+            }
+
+            uint64_t h = mix(lanes[0]) ^ mix(lanes[1] + 1) ^ mix(lanes[2] + 2) ^ mix(lanes[3] + 3);
+            for (; i < size; ++i) {
+                h = (h ^ data[i]) * HASH_PRIME;
+            }
+
+            return mix(h ^ size);
+        }
+
+        // Everything load() hands to the player comes from the header, so a
+        // torn or foreign file must not get past here.
+        bool headerIsValid(const CacheHeader& header, uint64_t key, uint32_t version, size_t file_size) {
+            if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+                header.version != version ||
+                header.header_size != sizeof(header) ||
+                header.key != key ||
+                header.channels == 0 ||
+                header.sample_rate == 0 ||
+                header.sample_format > static_cast<uint8_t>(SampleFormat::Float32LE)) {
+                return false;
+            }
+
+            auto sample_format = static_cast<SampleFormat>(header.sample_format);
+            uint64_t frame_size = bytesPerSample(sample_format) * header.channels;
+            return header.bits_per_sample == bytesPerSample(sample_format) * 8 &&
+                   header.data_size != 0 &&
+                   header.data_size % frame_size == 0 &&
+                   header.data_size == file_size - sizeof(header) &&
+                   header.loop_start_frame < header.data_size / frame_size;
+        }
+
+        // A writer that crashed between open and rename leaves its temporary
+        // file behind; one whose process is gone will never finish it.
+        bool isAbandonedTemp(const std::string& name) {
+            size_t pos = name.find(TMP_INFIX);
+            if (pos == std::string::npos) {
+                return false;
+            }
+            char* end = nullptr;
+            long pid = strtol(name.c_str() + pos + strlen(TMP_INFIX), &end, 10);
+            if (*end != '\0' || pid <= 0 || pid == getpid()) {
+                return false;
+            }
+            return kill(static_cast<pid_t>(pid), 0) < 0 && errno == ESRCH;
+        }
+
+        bool makeDirectories(const std::string& path) {
+            for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+                std::string part = path.substr(0, pos);
+                if (mkdir(part.c_str(), 0700) < 0 && errno != EEXIST) {
+                    return false;
+                }
+                if (pos == std::string::npos) {
+                    return true;
+                }
+            }
+        }
+
+    } // namespace
+
+    PcmCache::PcmCache(std::string directory) : directory(std::move(directory)) {}
+
+    std::string PcmCache::defaultDirectory() {
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+            return std::string(xdg) + "/desktop_ambient";
+        }
+        if (const char* home = std::getenv("HOME")) {
+            return std::string(home) + "/.cache/desktop_ambient";
+        }
+        return "";
+    }
+
+    uint64_t PcmCache::makeKey(const uint8_t* ogg_data, size_t ogg_size, const std::string& output_format) {
+        uint64_t format_hash = hashBytes(reinterpret_cast<const uint8_t*>(output_format.data()),
+                                         output_format.size(), CACHE_VERSION);
+        return hashBytes(ogg_data, ogg_size, format_hash);
+    }
+
+    std::string PcmCache::pathFor(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+        return directory + "/" + name + CACHE_SUFFIX;
+    }
+
+    bool PcmCache::load(uint64_t key, MappedFile& file, PcmFormat& format, const uint8_t*& pcm, size_t& pcm_size) {
+        last_error.clear();
+        if (directory.empty()) {
+            last_error = "No cache directory";
+            return false;
+        }
+
+        std::string path = pathFor(key);
+        if (access(path.c_str(), R_OK) != 0) {
+            last_error = "No cache entry";
+            return false;
+        }
+
+        MappedFile mapping;
+        if (!mapping.open(path)) {
+            last_error = mapping.getLastError();
+            return false;
+        }
+
+        CacheHeader header;
+        if (mapping.getSize() < sizeof(header)) {
+            last_error = "Truncated cache entry";
+            unlink(path.c_str());
+            return false;
+        }
+        memcpy(&header, mapping.getData(), sizeof(header));
+
+        if (!headerIsValid(header, key, CACHE_VERSION, mapping.getSize())) {
+            last_error = "Stale or corrupt cache entry";
+            unlink(path.c_str());
+            return false;
+        }
+
+        format.sample_rate = header.sample_rate;
+        format.channels = header.channels;
+        format.sample_format = static_cast<SampleFormat>(header.sample_format);
+        format.loop_start_frame = header.loop_start_frame;
+        pcm = mapping.getData() + sizeof(header);
+        pcm_size = header.data_size;
+        file = std::move(mapping);
+        return true;
+    }
+
+    bool PcmCache::store(uint64_t key, const PcmFormat& format, const uint8_t* pcm, size_t pcm_size) {
+        last_error.clear();
+        if (directory.empty() || !makeDirectories(directory)) {
+            last_error = "Cannot create cache directory " + directory;
+            return false;
+        }
+
+        CacheHeader header = {};
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.header_size = sizeof(header);
+        header.key = key;
+        header.data_size = pcm_size;
+        header.sample_rate = format.sample_rate;
+        header.channels = format.channels;
+        header.bits_per_sample = static_cast<uint8_t>(bytesPerSample(format.sample_format) * 8);
+        header.sample_format = static_cast<uint8_t>(format.sample_format);
+        header.loop_start_frame = format.loop_start_frame;
+
+        std::string path = pathFor(key);
+        std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+
+        int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            last_error = "open failed: " + std::string(strerror(errno));
+            return false;
+        }
+
+        auto writeAll = [fd](const void* data, size_t size) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            while (size > 0) {
+                ssize_t written = write(fd, bytes, size);
+                if (written < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                bytes += written;
+                size -= static_cast<size_t>(written);
+            }
+            return true;
+        };
+
+        bool ok = writeAll(&header, sizeof(header)) && writeAll(pcm, pcm_size);
+        if (!ok) {
+            last_error = "write failed: " + std::string(strerror(errno));
+        }
+        if (close(fd) < 0 && ok) {
+            last_error = "close failed: " + std::string(strerror(errno));
+            ok = false;
+        }
+        if (ok && rename(tmp_path.c_str(), path.c_str()) < 0) {
+            last_error = "rename failed: " + std::string(strerror(errno));
+            ok = false;
+        }
+        if (!ok) {
+            unlink(tmp_path.c_str());
+            return false;
+        }
+
+        prune(path);
+        return true;
+    }
+
+    // Entries for tracks or formats no longer in use are never hit again;
+    // keep only the most recently written ones, and drop the leftovers of
+    // crashed writers.
+    void PcmCache::prune(const std::string& keep) const {
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) {
+            return;
+        }
+
+        std::vector<std::pair<time_t, std::string>> entries;
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (isAbandonedTemp(name)) {
+                unlink((directory + "/" + name).c_str());
+                continue;
+            }
+            if (name.size() <= strlen(CACHE_SUFFIX) ||
+                name.compare(name.size() - strlen(CACHE_SUFFIX), std::string::npos, CACHE_SUFFIX) != 0) {
+                continue;
+            }
+
+            std::string path = directory + "/" + name;
+            struct stat st;
+            if (path != keep && stat(path.c_str(), &st) == 0) {
+                entries.emplace_back(st.st_mtime, path);
+            }
+        }
+        closedir(dir);
+
+        if (entries.size() < MAX_ENTRIES) {
+            return;
+        }
+
+        std::sort(entries.begin(), entries.end());
+        for (size_t i = 0; i + MAX_ENTRIES - 1 < entries.size(); ++i) {
+            unlink(entries[i].second.c_str());
+        }
+    }
+
+    const std::string& PcmCache::getLastError() const {
+        return last_error;
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "sample_format.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace ambient {
+
+    struct PcmFormat {
+        uint32_t sample_rate = 0;
+        uint8_t channels = 0;
+        SampleFormat sample_format = SampleFormat::S16LE;
+        uint64_t loop_start_frame = 0;  // where playback wraps to at the end
+    };
+
+    // Decoded PCM stored under $XDG_CACHE_HOME/desktop_ambient, one file per
+    // key: a fixed header followed by raw interleaved samples. Hits are
+    // mmapped, so a warm start costs one open and one mmap.
+    class PcmCache {
+    public:
+        explicit PcmCache(std::string directory);
+
+        static std::string defaultDirectory();
+
+        // Keys cover the Ogg bytes, the requested output format and the cache
+        // layout version, so any change to either side misses cleanly.
+        static uint64_t makeKey(const uint8_t* ogg_data, size_t ogg_size, const std::string& output_format);
+
+        bool load(uint64_t key, MappedFile& file, PcmFormat& format, const uint8_t*& pcm, size_t& pcm_size);
+        bool store(uint64_t key, const PcmFormat& format, const uint8_t* pcm, size_t pcm_size);
+
+        const std::string& getLastError() const;
+
+    private:
+        std::string pathFor(uint64_t key) const;
+        void prune(const std::string& keep) const;
+
+        std::string directory;
+        std::string last_error;
+
+        static constexpr uint32_t CACHE_VERSION = 3;
+        static constexpr size_t MAX_ENTRIES = 8;
+    };
+
+} //ambient
\ No newline at end of file
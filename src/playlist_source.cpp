@@ -0,0 +1,224 @@
+#include "playlist_source.h"
+#include "trace.h"
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace ambient {
+
+    static bool hasOggExtension(const std::string& name) {
+        if (name.size() < 4) {
+            return false;
+        }
+        std::string ext = name.substr(name.size() - 4);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext == ".ogg" || ext == ".oga";
+    }
+
+    std::vector<std::string> PlaylistSource::collectTracks(const std::vector<std::string>& entries) {
+        std::vector<std::string> result;
+
+        for (const std::string& entry : entries) {
+            struct stat st;
+            if (stat(entry.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                result.push_back(entry);
+                continue;
+            }
+
+            DIR* dir = opendir(entry.c_str());
+            if (!dir) {
+                std::cerr << "Cannot open playlist directory " << entry << std::endl;
+                continue;
+            }
+
+            std::vector<std::string> files;
+            while (dirent* item = readdir(dir)) {
+                if (item->d_name[0] != '.' && hasOggExtension(item->d_name)) {
+                    files.push_back(entry + "/" + item->d_name);
+                }
+            }
+            closedir(dir);
+
+            std::sort(files.begin(), files.end());
+            result.insert(result.end(), files.begin(), files.end());
+        }
+
+        return result;
+    }
+
+    PlaylistSource::PlaylistSource(std::vector<std::string> tracks, bool shuffle, TrackLoader loader)
+        : tracks(std::move(tracks)), shuffle(shuffle), rng(std::random_device{}()), loader(std::move(loader)) {
+        for (size_t i = 0; i < this->tracks.size(); ++i) {
+            order.push_back(i);
+        }
+        if (shuffle) {
+            std::shuffle(order.begin(), order.end(), rng);
+        }
+    }
+
+    PlaylistSource::~PlaylistSource() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // Walks the play order, reshuffling at the end of each pass without
+    // repeating the track that just finished.
+    size_t PlaylistSource::nextIndex() {
+        if (order_pos == order.size()) {
+            size_t last = order.back();
+            if (shuffle) {
+                std::shuffle(order.begin(), order.end(), rng);
+                if (order.size() > 1 && order.front() == last) {
+                    std::swap(order.front(), order.back());
+                }
+            }
+            order_pos = 0;
+        }
+        return order[order_pos++];
+    }
+
+    bool PlaylistSource::loadNext(LoadedTrack& track) {
+        for (size_t attempt = 0; attempt < tracks.size(); ++attempt) {
+            if (order_pos == order.size() && !looping) {
+                return false;
+            }
+            const std::string& path = tracks[nextIndex()];
+            if (!loader.load(path, started, track)) {
+                std::cerr << "Skipping " << path << ": " << loader.getLastError() << std::endl;
+                continue;
+            }
+
+            if (started && (track.format.sample_rate != format.sample_rate ||
+                            track.format.channels != format.channels ||
+                            track.format.sample_format != format.sample_format)) {
+                std::cerr << "Skipping " << path << ": " << track.format.sample_rate << " Hz, "
+                          << (int)track.format.channels << " channels does not match the playlist" << std::endl;
+                continue;
+            }
+
+            std::cout << "Playlist next: " << path << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    bool PlaylistSource::start(PcmFormat& format) {
+        LoadedTrack track;
+        if (!loadNext(track)) {
+            return false;
+        }
+
+        this->format = track.format;
+        format = track.format;
+        current = std::move(track.source);
+        started = true;
+        next_wanted = true;
+        worker = std::thread(&PlaylistSource::workerLoop, this);
+        return true;
+    }
+
+    void PlaylistSource::workerLoop() {
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+        AMBIENT_TRACE_THREAD("prefetch");
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this] { return stopping || retired || next_wanted; });
+            if (stopping) {
+                break;
+            }
+
+            std::unique_ptr<AudioSource> done = std::move(retired);
+            bool wanted = next_wanted;
+            next_wanted = false;
+            lock.unlock();
+
+            done.reset();
+
+            LoadedTrack track;
+            bool loaded = wanted && loadNext(track);
+
+            lock.lock();
+            if (loaded) {
+                next = std::move(track.source);
+            } else if (wanted) {
+                exhausted = true;
+            }
+        }
+    }
+
+    // Swaps in the prepared track if the worker is idle and has one ready;
+    // never waits for it.
+    bool PlaylistSource::advance() {
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock() || !next || retired) {
+            return false;
+        }
+
+        retired = std::move(current);
+        current = std::move(next);
+        next_wanted = true;
+        waiting_logged = false;
+        lock.unlock();
+        cv.notify_one();
+        return true;
+    }
+
+    size_t PlaylistSource::read(uint8_t* out, size_t bytes) {
+        // A skip that finds the next track still loading is retried on the
+        // following read; the current track plays on meanwhile.
+        if (skip_requested.load(std::memory_order_relaxed) && advance()) {
+            skip_requested.store(false, std::memory_order_relaxed);
+        }
+
+        size_t filled = 0;
+
+        while (filled < bytes) {
+            filled += current->read(out + filled, bytes - filled);
+            if (filled == bytes || advance()) {
+                continue;
+            }
+
+            // The current track is over and the next is not ready: keep the
+            // stream fed with silence instead of waiting on it, unless the
+            // playlist has ended.
+            {
+                std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+                if (lock.owns_lock() && !next && exhausted) {
+                    return filled;
+                }
+            }
+            if (!waiting_logged) {
+                std::cerr << "Next playlist track not ready, padding with silence" << std::endl;
+                waiting_logged = true;
+            }
+            memset(out + filled, 0, bytes - filled);
+            return bytes;
+        }
+
+        return filled;
+    }
+
+    bool PlaylistSource::skip() {
+        skip_requested.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    void PlaylistSource::setLooping(bool looping) {
+        this->looping = looping;
+    }
+
+} //ambient
\ No newline at end of file
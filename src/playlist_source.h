@@ -0,0 +1,69 @@
+#pragma once
+
+#include "audio_source.h"
+#include "track_loader.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ambient {
+
+    // Plays a list of tracks back to back, in order or shuffled. The next
+    // track is prepared on a low-priority worker while the current one
+    // plays, and the finished one is released there too, so read() never
+    // decodes, maps or frees; at most the current and next tracks are
+    // resident. Tracks whose format differs from the first are skipped.
+    class PlaylistSource : public AudioSource {
+    public:
+        PlaylistSource(std::vector<std::string> tracks, bool shuffle, TrackLoader loader);
+        ~PlaylistSource() override;
+
+        // Loads the first playable track on the calling thread and starts
+        // preparing the next one.
+        bool start(PcmFormat& format);
+
+        size_t read(uint8_t* out, size_t bytes) override;
+        void setLooping(bool looping) override;
+        bool skip() override;
+
+        // Expands directories to the Ogg files they contain, sorted by name.
+        static std::vector<std::string> collectTracks(const std::vector<std::string>& entries);
+
+    private:
+        void workerLoop();
+        bool loadNext(LoadedTrack& track);
+        bool advance();
+        size_t nextIndex();
+
+        std::vector<std::string> tracks;
+        std::vector<size_t> order;
+        size_t order_pos = 0;
+        bool shuffle;
+        std::mt19937 rng;
+        TrackLoader loader;
+        PcmFormat format;
+        bool started = false;   // set before the worker exists, so it may read it
+
+        std::unique_ptr<AudioSource> current;
+        std::atomic<bool> looping{true};  // off: end after one pass
+        bool waiting_logged = false;
+        std::atomic<bool> skip_requested{false};
+
+        // Shared with the worker.
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::unique_ptr<AudioSource> next;
+        std::unique_ptr<AudioSource> retired;
+        bool next_wanted = false;
+        bool exhausted = false;
+        bool stopping = false;
+        std::thread worker;
+    };
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace ambient {
+
+    namespace {
+
+        constexpr size_t CONVERT_FRAMES = 16384;
+
+        // Zeroth-order modified Bessel function, for the Kaiser window.
+        double besselI0(double x) {
+            double sum = 1.0;
+            double term = 1.0;
+            for (int k = 1; k < 50 && term > sum * 1e-12; ++k) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        }
+
+        double sinc(double x) {
+            return x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+        }
+
+    } // namespace
+
+    bool Resampler::setup(uint32_t input_rate, uint32_t output_rate, unsigned channels, SimdLevel level) {
+        if (input_rate == 0 || output_rate == 0 || channels == 0) {
+            return false;
+        }
+
+        const uint64_t common = std::gcd(input_rate, output_rate);
+        up = output_rate / common;
+        down = input_rate / common;
+        this->input_rate = input_rate;
+        this->output_rate = output_rate;
+        this->channels = channels;
+        dot = selectDotKernel(level);
+
+        // Ratios with more phases than the table holds (e.g. 44100 -> 47999)
+        // round each output to the nearest of MAX_PHASES positions instead.
+        phases = static_cast<size_t>(std::min<uint64_t>(up, MAX_PHASES));
+
+        // The cutoff sits below the lower of the two Nyquist rates; taps are
+        // padded to whole vectors with zeros.
+        const double cutoff = PASSBAND * std::min(1.0, static_cast<double>(output_rate) / input_rate);
+        const size_t half = static_cast<size_t>(std::ceil(ZERO_CROSSINGS / cutoff));
+        taps = 2 * half;
+        stride = (taps + 15) / 16 * 16;
+
+        filters.assign(phases * stride, 0.0f);
+        const double window_norm = besselI0(KAISER_BETA);
+
+        for (size_t p = 0; p < phases; ++p) {
+            float* row = filters.data() + p * stride;
+            const double frac = static_cast<double>(p) / phases;
+            double sum = 0.0;
+
+            for (size_t k = 0; k < taps; ++k) {
+                double x = static_cast<double>(k) - static_cast<double>(half - 1) - frac;
+                double r = x / half;
+                double window = besselI0(KAISER_BETA * std::sqrt(std::max(0.0, 1.0 - r * r))) / window_norm;
+                double h = cutoff * sinc(cutoff * x) * window;
+                row[k] = static_cast<float>(h);
+                sum += h;
+            }
+
+            // Unity gain at DC for every phase, so a constant stays constant.
+            for (size_t k = 0; k < taps; ++k) {
+                row[k] = static_cast<float>(row[k] / sum);
+            }
+        }
+
+        reset();
+        return true;
+    }
+
+    void Resampler::reset() {
+        // Half a filter of silence ahead of the first frame centres the
+        // first output on it.
+        const size_t lead = taps / 2 - 1;
+        history.assign(channels, std::vector<float>(lead, 0.0f));
+        position = 0;
+    }
+
+    void Resampler::prime(const float* in, size_t frames) {
+        const size_t lead = taps / 2 - 1;
+        const size_t n = std::min(frames, lead);
+        in += (frames - n) * channels;
+
+        for (unsigned c = 0; c < channels; ++c) {
+            for (size_t i = 0; i < n; ++i) {
+                history[c][lead - n + i] = in[i * channels + c];
+            }
+        }
+    }
+
+    void Resampler::process(const float* in, size_t frames, std::vector<float>& out) {
+        if (channels == 0) {
+            return;
+        }
+
+        for (unsigned c = 0; c < channels; ++c) {
+            std::vector<float>& h = history[c];
+            size_t base = h.size();
+            h.resize(base + frames);
+            for (size_t i = 0; i < frames; ++i) {
+                h[base + i] = in[i * channels + c];
+            }
+        }
+
+        const size_t available = history[0].size();
+        out.reserve(out.size() + (frames * up / down + 2) * channels);
+
+        while (true) {
+            size_t index = static_cast<size_t>(position / up);
+            const uint64_t frac = position % up;
+            size_t phase = static_cast<size_t>(frac);
+            if (phases != up) {
+                // Nearest table phase; past the last one it is phase 0 of
+                // the next input frame.
+                phase = static_cast<size_t>((frac * phases + up / 2) / up);
+                if (phase == phases) {
+                    phase = 0;
+                    ++index;
+                }
+            }
+            if (index + stride > available) {
+                break;
+            }
+            const float* row = filters.data() + phase * stride;
+
+            for (unsigned c = 0; c < channels; ++c) {
+                out.push_back(static_cast<float>(dot(row, history[c].data() + index, stride)));
+            }
+            position += down;
+        }
+
+        const size_t consumed = std::min(available, static_cast<size_t>(position / up));
+        for (std::vector<float>& h : history) {
+            h.erase(h.begin(), h.begin() + consumed);
+        }
+        position -= consumed * up;
+    }
+
+    size_t Resampler::getDelay() const {
+        return stride - taps / 2;
+    }
+
+    uint32_t Resampler::getInputRate() const {
+        return input_rate;
+    }
+
+    uint32_t Resampler::getOutputRate() const {
+        return output_rate;
+    }
+
+    void s16ToFloat(const int16_t* in, float* out, size_t samples) {
+        for (size_t i = 0; i < samples; ++i) {
+            out[i] = static_cast<float>(in[i]) * (1.0f / 32768.0f);
+        }
+    }
+
+    void floatToPcm(const float* in, size_t samples, SampleFormat format, uint8_t* out) {
+        switch (format) {
+            case SampleFormat::S16LE: {
+                int16_t* s = reinterpret_cast<int16_t*>(out);
+                for (size_t i = 0; i < samples; ++i) {
+                    float v = std::nearbyint(in[i] * 32768.0f);
+                    s[i] = static_cast<int16_t>(std::min(32767.0f, std::max(-32768.0f, v)));
+                }
+                break;
+            }
+            case SampleFormat::S32LE: {
+                int32_t* s = reinterpret_cast<int32_t*>(out);
+                for (size_t i = 0; i < samples; ++i) {
+                    double v = std::nearbyint(static_cast<double>(in[i]) * 2147483648.0);
+                    s[i] = static_cast<int32_t>(std::min(2147483647.0, std::max(-2147483648.0, v)));
+                }
+                break;
+            }
+            default: {
+                float* s = reinterpret_cast<float*>(out);
+                for (size_t i = 0; i < samples; ++i) {
+                    s[i] = std::min(1.0f, std::max(-1.0f, in[i]));
+                }
+                break;
+            }
+        }
+    }
+
+    bool convertPcm(std::vector<uint8_t>& pcm, uint32_t& sample_rate, unsigned channels, uint64_t& loop_start_frame,
+                    bool looping, uint32_t rate, SampleFormat format) {
+        const size_t frames = channels ? pcm.size() / (2 * channels) : 0;
+        if (frames == 0 || loop_start_frame >= frames) {
+            return false;
+        }
+
+        const int16_t* samples = reinterpret_cast<const int16_t*>(pcm.data());
+        const size_t out_frame_bytes = bytesPerSample(format) * channels;
+        std::vector<float> in(CONVERT_FRAMES * channels);
+        std::vector<uint8_t> result;
+
+        if (rate == sample_rate) {
+            result.resize(frames * out_frame_bytes);
+            for (size_t pos = 0; pos < frames; pos += CONVERT_FRAMES) {
+                size_t n = std::min(CONVERT_FRAMES, frames - pos) * channels;
+                s16ToFloat(samples + pos * channels, in.data(), n);
+                floatToPcm(in.data(), n, format, result.data() + pos * out_frame_bytes);
+            }
+            pcm.swap(result);
+            return true;
+        }
+
+        Resampler resampler;
+        if (!resampler.setup(sample_rate, rate, channels)) {
+            return false;
+        }
+
+        // Intro and loop are sized separately so the loop keeps its length
+        // to the nearest output frame.
+        const double ratio = static_cast<double>(rate) / sample_rate;
+        const uint64_t out_loop_start = static_cast<uint64_t>(std::llround(loop_start_frame * ratio));
+        const size_t out_frames = static_cast<size_t>(out_loop_start + std::llround((frames - loop_start_frame) * ratio));
+        result.reserve(out_frames * out_frame_bytes);
+
+        // A loop over the whole track wraps to its first frame, so that is
+        // filtered with the tail ahead of it.
+        const size_t loop_frames = frames - static_cast<size_t>(loop_start_frame);
+        if (looping && loop_start_frame == 0) {
+            const size_t lead = std::min(frames, CONVERT_FRAMES);
+            s16ToFloat(samples + (frames - lead) * channels, in.data(), lead * channels);
+            resampler.prime(in.data(), lead);
+        }
+
+        std::vector<float> out;
+        size_t produced = 0;
+        auto emit = [&]() {
+            size_t n = std::min(out.size() / channels, out_frames - produced);
+            result.resize((produced + n) * out_frame_bytes);
+            floatToPcm(out.data(), n * channels, format, result.data() + produced * out_frame_bytes);
+            produced += n;
+            out.clear();
+        };
+
+        for (size_t pos = 0; pos < frames; pos += CONVERT_FRAMES) {
+            size_t n = std::min(CONVERT_FRAMES, frames - pos);
+            s16ToFloat(samples + pos * channels, in.data(), n * channels);
+            resampler.process(in.data(), n, out);
+            emit();
+        }
+
+        // Run the filter past the end on what plays next, so the frames
+        // before the wrap are filtered as they will be heard.
+        const size_t tail = resampler.getDelay() + 1;
+        in.assign(tail * channels, 0.0f);
+        if (looping) {
+            for (size_t i = 0; i < tail; ++i) {
+                size_t frame = static_cast<size_t>(loop_start_frame) + i % loop_frames;
+                s16ToFloat(samples + frame * channels, in.data() + i * channels, channels);
+            }
+        }
+        resampler.process(in.data(), tail, out);
+        emit();
+
+        result.resize(out_frames * out_frame_bytes, 0);
+        pcm.swap(result);
+        sample_rate = rate;
+        loop_start_frame = out_loop_start;
+        return true;
+    }
+
+} //ambient
\ No newline at end of file
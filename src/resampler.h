@@ -0,0 +1,65 @@
+#pragma once
+
+#include "output_reference.h"
+#include "sample_format.h"
+#include "simd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ambient {
+
+    // Band-limited sample rate conversion through a polyphase bank of
+    // Kaiser-windowed sinc filters. Input and output are interleaved floats
+    // at full scale 1.0; each output sample is one vectorized dot product.
+    class Resampler {
+    public:
+        bool setup(uint32_t input_rate, uint32_t output_rate, unsigned channels,
+                   SimdLevel level = detectSimdLevel());
+        void reset();
+
+        // Replaces the silence assumed before the first frame with the end of
+        // `frames` frames of what really precedes it, e.g. a loop's tail.
+        void prime(const float* in, size_t frames);
+
+        // Appends the output that `frames` more input frames complete. Output
+        // lags input by getDelay() frames until the input is padded out.
+        void process(const float* in, size_t frames, std::vector<float>& out);
+
+        size_t getDelay() const;
+        uint32_t getInputRate() const;
+        uint32_t getOutputRate() const;
+
+    private:
+        std::vector<float> filters;  // phases rows of `stride` taps
+        std::vector<std::vector<float>> history;
+        DotKernel dot = selectDotKernel();
+        unsigned channels = 0;
+        uint32_t input_rate = 0;
+        uint32_t output_rate = 0;
+        uint64_t up = 1;             // the ratio in lowest terms
+        uint64_t down = 1;
+        size_t phases = 1;
+        size_t taps = 0;
+        size_t stride = 0;
+        uint64_t position = 0;       // next output, in 1/up input frames from history[0]
+
+        static constexpr size_t MAX_PHASES = 1024;
+        static constexpr double ZERO_CROSSINGS = 16.0;
+        static constexpr double KAISER_BETA = 8.0;
+        static constexpr double PASSBAND = 0.95;
+    };
+
+    // Sample layout conversion; the float side is at full scale 1.0 and is
+    // clipped on the way out.
+    void s16ToFloat(const int16_t* in, float* out, size_t samples);
+    void floatToPcm(const float* in, size_t samples, SampleFormat format, uint8_t* out);
+
+    // Converts a decoded S16 track in place to `rate` and `format`. A looping
+    // track is filtered as a loop and its loop start is moved with it, so the
+    // wrap stays seamless.
+    bool convertPcm(std::vector<uint8_t>& pcm, uint32_t& sample_rate, unsigned channels, uint64_t& loop_start_frame,
+                    bool looping, uint32_t rate, SampleFormat format);
+
+} //ambient
\ No newline at end of file
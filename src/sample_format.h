@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+namespace ambient {
+
+    // PCM layouts the DSP code handles natively. Anything else is requested
+    // from the server as Float32LE.
+    enum class SampleFormat {
+        S16LE,
+        S32LE,
+        Float32LE,
+    };
+
+    inline size_t bytesPerSample(SampleFormat format) {
+        return format == SampleFormat::S16LE ? 2 : 4;
+    }
+
+    inline const char* sampleFormatName(SampleFormat format) {
+        switch (format) {
+            case SampleFormat::S16LE: return "s16le";
+            case SampleFormat::S32LE: return "s32le";
+            default: return "float32le";
+        }
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+// Instruction-set plumbing shared by the DSP kernels. x86 builds carry
+// SSE2 and AVX2 variants and pick one at runtime; AArch64 builds always
+// have NEON.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AMBIENT_SIMD_X86 1
+#include <immintrin.h>
+#define AMBIENT_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define AMBIENT_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace ambient {
+
+    enum class SimdLevel {
+        Scalar,
+        Sse2,
+        Avx2,
+        Neon,
+    };
+
+    inline SimdLevel detectSimdLevel() {
+#if defined(AMBIENT_SIMD_X86)
+        static const SimdLevel level = __builtin_cpu_supports("avx2") ? SimdLevel::Avx2 : SimdLevel::Sse2;
+        return level;
+#elif defined(AMBIENT_SIMD_NEON)
+        return SimdLevel::Neon;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    inline const char* simdLevelName(SimdLevel level) {
+        switch (level) {
+            case SimdLevel::Sse2: return "sse2";
+            case SimdLevel::Avx2: return "avx2";
+            case SimdLevel::Neon: return "neon";
+            default: return "scalar";
+        }
+    }
+
+} //ambient
\ No newline at end of file
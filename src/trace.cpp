@@ -0,0 +1,200 @@
+#include "trace.h"
+
+#ifdef AMBIENT_TRACE
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ambient {
+namespace trace {
+
+    namespace {
+
+        enum class Kind : uint8_t {
+            Complete,  // payload: duration in ns
+            Instant,   // payload: double bits
+        };
+
+        // Fields are relaxed atomics so a dump may read a ring while its
+        // thread writes; on x86 and ARM they compile to plain moves.
+        struct Event {
+            std::atomic<const char*> name{nullptr};
+            std::atomic<uint64_t> start_ns{0};
+            std::atomic<uint64_t> payload{0};
+            std::atomic<Kind> kind{Kind::Instant};
+        };
+
+        constexpr size_t RING_EVENTS = 8192;
+        constexpr size_t RING_MASK = RING_EVENTS - 1;
+        static_assert((RING_EVENTS & RING_MASK) == 0, "RING_EVENTS must be a power of two");
+
+        // Owned by one thread, kept after it exits so its events still dump.
+        struct Ring {
+            pid_t tid = 0;
+            std::atomic<const char*> thread_name{nullptr};
+            std::atomic<uint64_t> head{0};
+            Event events[RING_EVENTS];
+        };
+
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<Ring>> rings;
+        };
+
+        Registry& registry() {
+            static Registry instance;
+            return instance;
+        }
+
+        Ring* registerThread() {
+            auto ring = std::make_unique<Ring>();
+            ring->tid = static_cast<pid_t>(syscall(SYS_gettid));
+
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.rings.push_back(std::move(ring));
+            return r.rings.back().get();
+        }
+
+        Ring& localRing() {
+            thread_local Ring* ring = registerThread();
+            return *ring;
+        }
+
+        void record(Kind kind, const char* name, uint64_t start_ns, uint64_t payload) {
+            Ring& ring = localRing();
+            uint64_t head = ring.head.load(std::memory_order_relaxed);
+            Event& event = ring.events[head & RING_MASK];
+            event.name.store(name, std::memory_order_relaxed);
+            event.start_ns.store(start_ns, std::memory_order_relaxed);
+            event.payload.store(payload, std::memory_order_relaxed);
+            event.kind.store(kind, std::memory_order_relaxed);
+            ring.head.store(head + 1, std::memory_order_release);
+        }
+
+        struct Snapshot {
+            const char* name;
+            uint64_t start_ns;
+            uint64_t payload;
+            Kind kind;
+        };
+
+        // Copies the ring, then drops whatever its thread may have
+        // overwritten while the copy was taken.
+        std::vector<Snapshot> snapshot(const Ring& ring) {
+            uint64_t end = ring.head.load(std::memory_order_acquire);
+            uint64_t begin = end > RING_EVENTS ? end - RING_EVENTS : 0;
+
+            std::vector<Snapshot> events;
+            events.reserve(static_cast<size_t>(end - begin));
+            for (uint64_t i = begin; i < end; ++i) {
+                const Event& event = ring.events[i & RING_MASK];
+                events.push_back({event.name.load(std::memory_order_relaxed),
+                                  event.start_ns.load(std::memory_order_relaxed),
+                                  event.payload.load(std::memory_order_relaxed),
+                                  event.kind.load(std::memory_order_relaxed)});
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t after = ring.head.load(std::memory_order_relaxed);
+            uint64_t valid = after + 1 > RING_EVENTS ? after + 1 - RING_EVENTS : 0;
+            if (valid > begin) {
+                events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(std::min(valid, end) - begin));
+            }
+            return events;
+        }
+
+    } // namespace
+
+    uint64_t nowNs() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void complete(const char* name, uint64_t start_ns) {
+        record(Kind::Complete, name, start_ns, nowNs() - start_ns);
+    }
+
+    void instant(const char* name, double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        record(Kind::Instant, name, nowNs(), bits);
+    }
+
+    void setThreadName(const char* name) {
+        localRing().thread_name.store(name, std::memory_order_relaxed);
+    }
+
+    bool writeChromeTrace(const std::string& path, std::string& error) {
+        std::string tmp_path = path + ".tmp";
+        FILE* out = fopen(tmp_path.c_str(), "w");
+        if (!out) {
+            error = "open failed: " + std::string(strerror(errno));
+            return false;
+        }
+
+        const int pid = static_cast<int>(getpid());
+        bool first = true;
+        auto separator = [&]() {
+            fputs(first ? "\n" : ",\n", out);
+            first = false;
+        };
+
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const auto& ring : r.rings) {
+            if (const char* thread_name = ring->thread_name.load(std::memory_order_relaxed)) {
+                separator();
+                fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                        pid, static_cast<int>(ring->tid), thread_name);
+            }
+
+            for (const Snapshot& event : snapshot(*ring)) {
+                separator();
+                double ts_us = event.start_ns / 1000.0;
+                if (event.kind == Kind::Complete) {
+                    fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                            event.name, pid, static_cast<int>(ring->tid), ts_us, event.payload / 1000.0);
+                } else {
+                    double value;
+                    memcpy(&value, &event.payload, sizeof(value));
+                    fprintf(out, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+                                 "\"args\":{\"value\":%.9g}}",
+                            event.name, pid, static_cast<int>(ring->tid), ts_us, value);
+                }
+            }
+        }
+
+        fputs("\n]}\n", out);
+        bool ok = fflush(out) == 0 && !ferror(out);
+        if (fclose(out) != 0) {
+            ok = false;
+        }
+        if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            error = "write failed: " + std::string(strerror(errno));
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    std::string defaultPath() {
+        const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+        return std::string(runtime && *runtime ? runtime : "/tmp") + "/desktop_ambient.trace.json";
+    }
+
+} //trace
+} //ambient
+
+#endif
\ No newline at end of file
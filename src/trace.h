@@ -0,0 +1,61 @@
+#pragma once
+
+// Per-thread event rings for post-mortem timelines. Recording an event is a
+// clock read and a few relaxed stores into the calling thread's ring; the
+// rings are dumped as Chrome trace-event JSON on request. Builds without
+// AMBIENT_TRACE compile every trace point out.
+
+#ifdef AMBIENT_TRACE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ambient {
+namespace trace {
+
+    uint64_t nowNs();
+
+    // A span that started at `start_ns` and ends now.
+    void complete(const char* name, uint64_t start_ns);
+    // A point event carrying one number.
+    void instant(const char* name, double value);
+    // Labels the calling thread in dumps; `name` must outlive the process.
+    void setThreadName(const char* name);
+
+    // Writes every thread's ring as Chrome trace-event JSON, replacing
+    // `path` atomically.
+    bool writeChromeTrace(const std::string& path, std::string& error);
+
+    // $XDG_RUNTIME_DIR/desktop_ambient.trace.json, /tmp without one.
+    std::string defaultPath();
+
+    class Scope {
+    public:
+        explicit Scope(const char* name) : name(name), start_ns(nowNs()) {}
+        ~Scope() { complete(name, start_ns); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name;
+        uint64_t start_ns;
+    };
+
+} //trace
+} //ambient
+
+#define AMBIENT_TRACE_JOIN2(a, b) a##b
+#define AMBIENT_TRACE_JOIN(a, b) AMBIENT_TRACE_JOIN2(a, b)
+#define AMBIENT_TRACE_SCOPE(name) ::ambient::trace::Scope AMBIENT_TRACE_JOIN(ambient_trace_scope_, __LINE__)(name)
+#define AMBIENT_TRACE_INSTANT(name, value) ::ambient::trace::instant(name, value)
+#define AMBIENT_TRACE_THREAD(name) ::ambient::trace::setThreadName(name)
+
+#else
+
+#define AMBIENT_TRACE_SCOPE(name) do {} while (0)
+#define AMBIENT_TRACE_INSTANT(name, value) do {} while (0)
+#define AMBIENT_TRACE_THREAD(name) do {} while (0)
+
+#endif
\ No newline at end of file
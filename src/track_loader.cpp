@@ -0,0 +1,220 @@
+#include "track_loader.h"
+#include "ogg_decoder.h"
+#include "resampler.h"
+
+#ifdef AMBIENT_EMBED_TRACK
+#include "audio.h"
+#endif
+
+#include <iostream>
+
+namespace ambient {
+
+    static bool hasOggSignature(const uint8_t* data, size_t size) {
+        return size >= 4 && data[0] == 'O' && data[1] == 'g' && data[2] == 'g' && data[3] == 'S';
+    }
+
+    static size_t frameBytes(const PcmFormat& format) {
+        return static_cast<size_t>(format.channels) * bytesPerSample(format.sample_format);
+    }
+
+    static PcmFormat formatOf(const OggDecoder& decoder) {
+        PcmFormat format;
+        format.sample_rate = decoder.getSampleRate();
+        format.channels = decoder.getChannels();
+        format.loop_start_frame = decoder.getLoopStart();
+        return format;
+    }
+
+    TrackLoader::TrackLoader(const Config& config, bool looping)
+        : cache_dir(config.cache_dir.empty() ? PcmCache::defaultDirectory() : config.cache_dir),
+          use_cache(config.pcm_cache),
+          streaming(config.streaming),
+          loop_crossfade_ms(looping ? config.loop_crossfade_ms : 0),
+          decode_threads(static_cast<unsigned>(config.decode_threads)),
+          looping(looping) {
+    }
+
+    void TrackLoader::setOutputFormat(uint32_t sample_rate, SampleFormat format) {
+        output_rate = sample_rate;
+        output_format = format;
+    }
+
+    bool TrackLoader::mapInput(const std::string& path, MappedFile& file, const uint8_t*& data, size_t& size,
+                               std::string& error) const {
+        if (path.empty()) {
+#ifdef AMBIENT_EMBED_TRACK
+            data = audio_data.data();
+            size = audio_size;
+#else
+            error = "No track configured and no embedded track compiled in";
+            return false;
+#endif
+        } else {
+            if (!file.open(path)) {
+                error = "Failed to map track " + path + ": " + file.getLastError();
+                return false;
+            }
+            data = file.getData();
+            size = file.getSize();
+        }
+
+        if (!hasOggSignature(data, size)) {
+            error = "Invalid OGG signature in " + (path.empty() ? std::string("embedded track") : path);
+            return false;
+        }
+        return true;
+    }
+
+    // The key names the stored format and the loop crossfade baked into the
+    // samples; without an output format that is the decoder's S16.
+    uint64_t TrackLoader::cacheKey(const uint8_t* data, size_t size) const {
+        std::string format = std::string(sampleFormatName(output_format)) + "@" +
+                             (output_rate ? std::to_string(output_rate) : std::string("native")) +
+                             "/xfade" + std::to_string(loop_crossfade_ms);
+        return PcmCache::makeKey(data, size, format);
+    }
+
+    bool TrackLoader::needsConversion(const PcmFormat& format) const {
+        return output_rate != 0 && (format.sample_rate != output_rate || format.sample_format != output_format);
+    }
+
+    bool TrackLoader::convert(std::vector<uint8_t>& pcm, PcmFormat& format) const {
+        if (!needsConversion(format)) {
+            return true;
+        }
+        if (!convertPcm(pcm, format.sample_rate, format.channels, format.loop_start_frame, looping,
+                        output_rate, output_format)) {
+            return false;
+        }
+        format.sample_format = output_format;
+        return true;
+    }
+
+    bool TrackLoader::store(PcmCache& cache, uint64_t key, const PcmFormat& format, const std::vector<uint8_t>& pcm) {
+        if (!cache.store(key, format, pcm.data(), pcm.size())) {
+            std::cerr << "Failed to write PCM cache: " << cache.getLastError() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool TrackLoader::loadCached(PcmCache& cache, uint64_t key, LoadedTrack& track) const {
+        MappedFile cache_file;
+        const uint8_t* pcm = nullptr;
+        size_t pcm_size = 0;
+
+        if (!cache.load(key, cache_file, track.format, pcm, pcm_size)) {
+            return false;
+        }
+
+        track.source = std::make_unique<BufferSource>(std::move(cache_file), pcm, pcm_size,
+                                                      track.format.loop_start_frame * frameBytes(track.format));
+        track.source->setLooping(looping);
+        std::cout << "\tLoaded " << pcm_size << " bytes of PCM from cache\n";
+        return true;
+    }
+
+    bool TrackLoader::load(const std::string& path, bool background, LoadedTrack& track) {
+        last_error.clear();
+        track = LoadedTrack();
+
+        MappedFile file;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        if (!mapInput(path, file, data, size, last_error)) {
+            return false;
+        }
+
+        PcmCache cache(cache_dir);
+        uint64_t key = use_cache ? cacheKey(data, size) : 0;
+        if (use_cache && loadCached(cache, key, track)) {
+            return true;
+        }
+
+        if (streaming && !(background && use_cache)) {
+            auto stream_source = std::make_unique<StreamingSource>();
+            bool opened = path.empty() ? stream_source->open(data, size, loop_crossfade_ms)
+                                       : stream_source->open(std::move(file), loop_crossfade_ms);
+            if (!opened) {
+                last_error = "Failed to open Ogg Vorbis stream: " + stream_source->getDecoder().getLastError();
+                return false;
+            }
+
+            track.format = formatOf(stream_source->getDecoder());
+            track.needs_cache = use_cache;
+            track.source = std::move(stream_source);
+            if (needsConversion(track.format)) {
+                track.source = std::make_unique<ConvertingSource>(std::move(track.source), track.format.sample_rate,
+                                                                  track.format.channels, output_rate, output_format);
+                track.format.sample_rate = output_rate;
+                track.format.sample_format = output_format;
+            }
+            track.source->setLooping(looping);
+            std::cout << "\tStreaming " << (path.empty() ? "embedded track" : path) << "\n";
+            return true;
+        }
+
+        OggDecoder decoder;
+        decoder.setLoopCrossfade(loop_crossfade_ms);
+        decoder.setDecodeThreads(decode_threads);
+        if (!decoder.decode(data, size)) {
+            last_error = "Failed to decode Ogg Vorbis data: " + decoder.getLastError();
+            return false;
+        }
+
+        PcmFormat format = formatOf(decoder);
+        std::vector<uint8_t> pcm = decoder.takePcmData();
+        if (!convert(pcm, format)) {
+            last_error = "Failed to convert decoded audio to " + std::to_string(output_rate) + " Hz";
+            return false;
+        }
+
+        if (use_cache && store(cache, key, format, pcm) && background && loadCached(cache, key, track)) {
+            return true;
+        }
+
+        track.format = format;
+        track.source = std::make_unique<BufferSource>(std::move(pcm), format.loop_start_frame * frameBytes(format));
+        track.source->setLooping(looping);
+        std::cout << "\tDecoded " << (path.empty() ? "embedded track" : path) << "\n";
+        return true;
+    }
+
+    bool TrackLoader::fillCache(const std::string& path, const std::atomic<bool>& cancel) const {
+        MappedFile file;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        std::string error;
+        if (!mapInput(path, file, data, size, error)) {
+            std::cerr << "Background decode failed: " << error << std::endl;
+            return false;
+        }
+
+        OggDecoder decoder;
+        decoder.setLoopCrossfade(loop_crossfade_ms);
+        decoder.setDecodeThreads(decode_threads);
+        decoder.setCancelFlag(&cancel);
+        if (!decoder.decode(data, size)) {
+            if (!cancel) {
+                std::cerr << "Background decode failed: " << decoder.getLastError() << std::endl;
+            }
+            return false;
+        }
+
+        PcmFormat format = formatOf(decoder);
+        std::vector<uint8_t> pcm = decoder.takePcmData();
+        if (!convert(pcm, format)) {
+            std::cerr << "Background decode failed: cannot convert to " << output_rate << " Hz" << std::endl;
+            return false;
+        }
+
+        PcmCache cache(cache_dir);
+        return store(cache, cacheKey(data, size), format, pcm);
+    }
+
+    const std::string& TrackLoader::getLastError() const {
+        return last_error;
+    }
+
+} //ambient
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "audio_source.h"
+#include "config.h"
+#include "pcm_cache.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ambient {
+
+    struct LoadedTrack {
+        std::unique_ptr<AudioSource> source;
+        PcmFormat format;
+        bool needs_cache = false;  // streaming a cache miss; see fillCache()
+    };
+
+    // Turns an Ogg file, or the embedded track when the path is empty, into
+    // a playable source in the output format: mapped from the PCM cache when
+    // possible, otherwise streamed or decoded as configured.
+    class TrackLoader {
+    public:
+        TrackLoader(const Config& config, bool looping);
+
+        // Converts tracks to this rate and sample format at load time, so
+        // the server plays them without conversion. Unset, tracks keep the
+        // decoder's.
+        void setOutputFormat(uint32_t sample_rate, SampleFormat format);
+
+        // Background callers run at low priority and can afford to decode a
+        // cache miss in full; with the cache on, the track then plays from
+        // its mapping rather than from decoded PCM on the heap.
+        bool load(const std::string& path, bool background, LoadedTrack& track);
+
+        // Decodes `path` into the PCM cache. Safe to call from another
+        // thread while the loader is in use; gives up without writing once
+        // `cancel` is set.
+        bool fillCache(const std::string& path, const std::atomic<bool>& cancel) const;
+
+        const std::string& getLastError() const;
+
+    private:
+        bool mapInput(const std::string& path, MappedFile& file, const uint8_t*& data, size_t& size,
+                      std::string& error) const;
+        bool loadCached(PcmCache& cache, uint64_t key, LoadedTrack& track) const;
+        uint64_t cacheKey(const uint8_t* data, size_t size) const;
+        bool convert(std::vector<uint8_t>& pcm, PcmFormat& format) const;
+        bool needsConversion(const PcmFormat& format) const;
+        static bool store(PcmCache& cache, uint64_t key, const PcmFormat& format, const std::vector<uint8_t>& pcm);
+
+        std::string cache_dir;
+        bool use_cache;
+        bool streaming;
+        int loop_crossfade_ms;
+        unsigned decode_threads;
+        bool looping;
+        uint32_t output_rate = 0;
+        SampleFormat output_format = SampleFormat::S16LE;
+        std::string last_error;
+    };
+
+} //ambient
\ No newline at end of file